@@ -1,6 +1,9 @@
 // Copyright (c) 2018 Ethan Margaillan <contact@ethan.jp>.
 // Licensed under the MIT Licence - https://raw.githubusercontent.com/Ethan13310/Thread-Pool-Cpp/master/LICENSE
 
+// The PHY thread pool the modem used before WorkerPool, unchanged apart from this note.
+// Only kept as the baseline for worker_pool_bench.
+
 #pragma once
 
 #include <atomic>
@@ -0,0 +1,94 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+// Sample rate and OFDM demodulation cost per subframe with standard and reduced symbol sizes
+// (modem.phy.standard_symbol_size), for all LTE bandwidths.
+//
+// Every subframe runs through srsran_ofdm_rx_sf, the FFT step of the CAS and MBSFN processors.
+// Decoding success depends on the signal and is not covered: replay the same capture once with
+// each setting and compare the BLER in the measurement log.
+//
+// Usage: symbol_size_bench [subframes]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "srsran/srsran.h"
+
+/**
+ *  Demodulate the given number of subframes of random samples, returns the average time per subframe in us
+ */
+static double demodulate(uint32_t nof_prb, unsigned subframes) {
+  uint32_t sf_len = SRSRAN_SF_LEN_PRB(nof_prb);
+  cf_t* in = srsran_vec_cf_malloc(sf_len);
+  cf_t* out = srsran_vec_cf_malloc(SRSRAN_SF_LEN_RE(nof_prb, SRSRAN_CP_NORM));
+  for (uint32_t i = 0; i < sf_len; i++) {
+    in[i] = {static_cast<float>(rand()) / RAND_MAX - 0.5F, static_cast<float>(rand()) / RAND_MAX - 0.5F};
+  }
+
+  srsran_ofdm_t ofdm = {};
+  srsran_ofdm_cfg_t cfg = {};
+  cfg.nof_prb = nof_prb;
+  cfg.cp = SRSRAN_CP_NORM;
+  cfg.in_buffer = in;
+  cfg.out_buffer = out;
+  cfg.sf_type = SRSRAN_SF_NORM;
+  if (srsran_ofdm_rx_init_cfg(&ofdm, &cfg) != SRSRAN_SUCCESS) {
+    fprintf(stderr, "Could not init OFDM receiver for %u PRB\n", nof_prb);
+    exit(1);
+  }
+
+  // Warm up, the first run touches the buffers and FFT plan
+  srsran_ofdm_rx_sf(&ofdm);
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < subframes; i++) {
+    srsran_ofdm_rx_sf(&ofdm);
+  }
+  auto us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  srsran_ofdm_rx_free(&ofdm);
+  free(in);
+  free(out);
+  return us / subframes;
+}
+
+auto main(int argc, char** argv) -> int {
+  unsigned subframes = argc > 1 ? atoi(argv[1]) : 10000;
+  const uint32_t prbs[] = {6, 15, 25, 50, 75, 100};
+
+  printf("%4s | %10s %10s %12s | %10s %10s %12s | %8s\n", "PRB", "std FFT", "std Msps", "std us/sf",
+      "red. FFT", "red. Msps", "red. us/sf", "CPU");
+  for (auto nof_prb : prbs) {
+    srsran_use_standard_symbol_size(true);
+    int std_sz = srsran_symbol_sz(nof_prb);
+    double std_rate = srsran_sampling_freq_hz(nof_prb);
+    auto std_us = demodulate(nof_prb, subframes);
+
+    srsran_use_standard_symbol_size(false);
+    int red_sz = srsran_symbol_sz(nof_prb);
+    double red_rate = srsran_sampling_freq_hz(nof_prb);
+    auto red_us = demodulate(nof_prb, subframes);
+
+    printf("%4u | %10d %10.2f %12.1f | %10d %10.2f %12.1f | %7.0f%%\n", nof_prb, std_sz, std_rate / 1e6, std_us,
+        red_sz, red_rate / 1e6, red_us, 100.0 * red_us / std_us);
+  }
+  return 0;
+}
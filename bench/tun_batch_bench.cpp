@@ -0,0 +1,173 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+// Packet rate of the TUN egress: one write per packet, as the gateway did before, against the
+// per transport block batches of TunQueue, with and without UDP segmentation offload.
+//
+// Every transport block carries the UDP datagrams of one flow. The default sizes are those of a
+// 20 MHz carrier at MCS 27 (9422 byte TBs, about 7 datagrams of 1316 byte payload each), which
+// needs about 7000 packets/s. Creates the TUN interface, so it has to run as root.
+//
+// Usage: tun_batch_bench [transport blocks] [packets per TB] [UDP payload bytes] [interface]
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "srsran/common/buffer_pool.h"
+#include "Checksum.h"
+#include "TunQueue.h"
+
+static auto open_tun(const std::string& name, bool vnet_hdr) -> int {
+  int fd = open("/dev/net/tun", O_RDWR);
+  if (fd < 0) {
+    perror("/dev/net/tun");
+    return -1;
+  }
+  ifreq ifr = {};
+  ifr.ifr_flags = IFF_TUN | IFF_NO_PI | (vnet_hdr ? IFF_VNET_HDR : 0);
+  strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+  if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+    perror("TUNSETIFF");
+    close(fd);
+    return -1;
+  }
+
+  // Packets written to an interface that is down are rejected
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  ifr.ifr_flags = IFF_UP;
+  if (ioctl(sock, SIOCSIFFLAGS, &ifr) < 0) {
+    perror("SIOCSIFFLAGS");
+  }
+  close(sock);
+  return fd;
+}
+
+static void make_packet(srsran::byte_buffer_t& pdu, uint32_t payload_len, uint16_t seq) {
+  auto ip_hdr = reinterpret_cast<iphdr*>(pdu.msg);
+  auto udp_hdr = reinterpret_cast<udphdr*>(pdu.msg + sizeof(iphdr));
+  pdu.N_bytes = sizeof(iphdr) + sizeof(udphdr) + payload_len;
+  memset(pdu.msg, 0, pdu.N_bytes);
+  ip_hdr->version = 4;
+  ip_hdr->ihl = 5;
+  ip_hdr->tot_len = htons(pdu.N_bytes);
+  ip_hdr->id = htons(seq);
+  ip_hdr->ttl = 1;
+  ip_hdr->protocol = IPPROTO_UDP;
+  ip_hdr->saddr = inet_addr("10.255.0.1");
+  ip_hdr->daddr = inet_addr("239.255.0.1");
+  ip_hdr->check = Checksum::ip_header(ip_hdr);
+  udp_hdr->source = htons(5000);
+  udp_hdr->dest = htons(5000);
+  udp_hdr->len = htons(sizeof(udphdr) + payload_len);
+}
+
+/**
+ *  Build the packets of one transport block
+ */
+static auto transport_block(unsigned packets, uint32_t payload_len, uint16_t& seq)
+    -> std::vector<srsran::unique_byte_buffer_t> {
+  std::vector<srsran::unique_byte_buffer_t> tb;
+  for (unsigned i = 0; i < packets; i++) {
+    auto pdu = srsran::make_byte_buffer();
+    make_packet(*pdu, payload_len, seq++);
+    tb.push_back(std::move(pdu));
+  }
+  return tb;
+}
+
+static void report(const char* name, unsigned tbs, unsigned packets, uint32_t payload_len,
+    std::chrono::steady_clock::duration duration, uint64_t writes) {
+  auto seconds = std::chrono::duration<double>(duration).count();
+  auto total = static_cast<double>(tbs) * packets;
+  printf("%-20s %10.0f packets/s, %8.1f Mbit/s, %5.2f packets per write\n", name, total / seconds,
+      total * (payload_len + sizeof(iphdr) + sizeof(udphdr)) * 8 / seconds / 1e6, writes ? total / writes : 0.0);
+}
+
+auto main(int argc, char** argv) -> int {
+  unsigned tbs = argc > 1 ? atoi(argv[1]) : 20000;
+  unsigned packets = argc > 2 ? atoi(argv[2]) : 7;
+  uint32_t payload_len = argc > 3 ? atoi(argv[3]) : 1316;
+  std::string name = argc > 4 ? argv[4] : "tunbench0";
+  uint16_t seq = 0;
+
+  printf("%u transport blocks of %u packets, %u byte UDP payload\n", tbs, packets, payload_len);
+
+  {
+    // Gateway before batching: every packet written as soon as PDCP hands it over
+    int fd = open_tun(name, false);
+    if (fd < 0) {
+      return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < tbs; i++) {
+      for (auto& pdu : transport_block(packets, payload_len, seq)) {
+        if (write(fd, pdu->msg, pdu->N_bytes) < 0) {
+          perror("write");
+          return 1;
+        }
+      }
+    }
+    report("write per packet", tbs, packets, payload_len, std::chrono::steady_clock::now() - start,
+        static_cast<uint64_t>(tbs) * packets);
+    close(fd);
+  }
+
+  for (bool gso : {false, true}) {
+    int fd = open_tun(name, gso);
+    if (fd < 0) {
+      return 1;
+    }
+    if (gso && !TunQueue::enable_gso(fd)) {
+      printf("%-20s not supported by this kernel\n", "TunQueue, GSO");
+      close(fd);
+      break;
+    }
+    RestHandler::TunQueueInfo stats;
+    TunQueue queue(fd, gso, stats);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < tbs; i++) {
+      for (auto& pdu : transport_block(packets, payload_len, seq)) {
+        queue.add(std::move(pdu));
+      }
+      queue.flush();
+    }
+    report(gso ? "TunQueue, GSO" : "TunQueue", tbs, packets, payload_len, std::chrono::steady_clock::now() - start,
+        stats.writes);
+    if (stats.errors > 0) {
+      printf("%-20s %" PRIu64 " write errors\n", "", stats.errors.load());
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,170 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+// Dispatch-to-start latency of the PHY worker pool, compared to the thread pool it replaced.
+//
+// A dispatcher thread stands in for the main loop: it pushes one job per subframe period, and
+// every job spins for the given work time, like a frame processor would. Each job belongs to one of
+// as many processors as there are workers, picked at random like from the idle list. Reported is the time from push() until the job starts running on a worker,
+// and how often a processor ran on the same worker as for its previous subframe (locality).
+//
+// Usage: worker_pool_bench [threads] [subframes] [work us] [period us]
+//        Without a thread count, runs with 4, 8 and 16 threads.
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+#include "legacy_thread_pool.hpp"
+#include "WorkerPool.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+/**
+ *  One dispatched subframe
+ */
+struct Subframe {
+  bench_clock::time_point dispatched;
+  uint64_t latency_ns = 0;
+  unsigned processor = 0;
+  std::thread::id worker;
+};
+
+static std::chrono::microseconds work_time(300);
+static std::vector<Subframe> subframes;
+static std::atomic<unsigned> completed = {0};
+
+static void spin(std::chrono::microseconds duration) {
+  auto end = bench_clock::now() + duration;
+  while (bench_clock::now() < end) {}
+}
+
+static void run_subframe(void* obj, uint32_t /*tti*/) {
+  auto sf = static_cast<Subframe*>(obj);
+  sf->latency_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        bench_clock::now() - sf->dispatched).count());
+  sf->worker = std::this_thread::get_id();
+  spin(work_time);
+  completed++;
+}
+
+static void skip_subframe(void* /*obj*/, uint32_t /*tti*/) {}
+
+static void report(const char* name, double seconds, unsigned processors) {
+  std::vector<uint64_t> latencies;
+  for (const auto& sf : subframes) {
+    latencies.push_back(sf.latency_ns);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  uint64_t sum = 0;
+  for (auto latency : latencies) {
+    sum += latency;
+  }
+  // Compared to the previous subframe of the same processor
+  std::vector<std::thread::id> last_worker(processors);
+  unsigned same_worker = 0;
+  for (const auto& sf : subframes) {
+    same_worker += sf.worker == last_worker[sf.processor] ? 1 : 0;
+    last_worker[sf.processor] = sf.worker;
+  }
+  auto n = latencies.size();
+  printf("%-12s %8zu jobs in %6.2f s: latency avg %8.1f us, p50 %8.1f us, p99 %8.1f us, max %8.1f us, "
+      "locality %5.1f %%\n", name, n, seconds, sum / 1e3 / n, latencies[n / 2] / 1e3, latencies[n * 99 / 100] / 1e3,
+      latencies[n - 1] / 1e3, same_worker * 100.0 / n);
+}
+
+template <class Push>
+static double dispatch(unsigned count, unsigned processors, std::chrono::microseconds period, Push push) {
+  subframes.assign(count, Subframe());
+  completed = 0;
+  // Same sequence of processors for both pools
+  std::minstd_rand random(1);
+  for (auto& sf : subframes) {
+    sf.processor = random() % processors;
+  }
+  auto start = bench_clock::now();
+  auto next = start;
+  for (unsigned i = 0; i < count; i++) {
+    if (period.count() > 0) {
+      next += period;
+      while (bench_clock::now() < next) {}
+    }
+    subframes[i].dispatched = bench_clock::now();
+    while (!push(i)) {
+      std::this_thread::yield();
+    }
+  }
+  while (completed < count) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void run(unsigned threads, unsigned count, std::chrono::microseconds period) {
+  printf("%u threads, %u subframes, %" PRId64 " us work, one subframe every %" PRId64 " us\n", threads, count,
+      static_cast<int64_t>(work_time.count()), static_cast<int64_t>(period.count()));
+
+  {
+    thread_pool pool(threads);
+    auto seconds = dispatch(count, threads, period,
+        [&pool](unsigned i) {
+          pool.push([i]() { run_subframe(&subframes[i], i); });
+          return true;
+        });
+    report("thread_pool", seconds, threads);
+  }
+
+  {
+    WorkerPool pool(threads, 10, 16);
+    auto seconds = dispatch(count, threads, period,
+        [&pool](unsigned i) {
+          return pool.push(run_subframe, skip_subframe, &subframes[i], i, std::chrono::microseconds(0),
+              subframes[i].processor);
+        });
+    report("WorkerPool", seconds, threads);
+    printf("%-12s %8" PRIu64 " jobs stolen\n", "", pool.dispatch_latency(true).stolen);
+  }
+}
+
+auto main(int argc, char** argv) -> int {
+  std::vector<unsigned> thread_counts = {4, 8, 16};
+  if (argc > 1) {
+    thread_counts = {static_cast<unsigned>(atoi(argv[1]))};
+  }
+  unsigned count = argc > 2 ? atoi(argv[2]) : 5000;
+  work_time = std::chrono::microseconds(argc > 3 ? atoi(argv[3]) : 300);
+  auto period = std::chrono::microseconds(argc > 4 ? atoi(argv[4]) : 1000);
+  spdlog::set_level(spdlog::level::warn);
+
+  for (auto threads : thread_counts) {
+    run(threads, count, period);
+  }
+  return 0;
+}
@@ -0,0 +1,129 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <libconfig.h++>
+
+class ReceiveChain;
+
+/**
+ *  Public API of the modem library.
+ *
+ *  A Modem is one complete receive chain: SDR (or sample file) input, cell search and synchronization,
+ *  the CAS and MBSFN frame processors, MAC / RLC / PDCP and the network gateway. All parameters are read
+ *  from the passed configuration, as documented for the modem executable.
+ *
+ *  Applications that want the received IP packets in-process register a packet callback. It is called
+ *  on the delivery thread for every IP packet, in addition to the egress configured in modem.gw.egress.
+ *  Set modem.gw.egress to "none" to receive the packets through the callback only.
+ *
+ *  Only one receive chain per SDR device can be active at a time. Logging goes through the spdlog
+ *  default logger, the application can set it up before calling init().
+ */
+class Modem {
+  public:
+    /**
+     *  Options that are not part of the configuration file
+     */
+    struct Options {
+      std::string sample_file;        /**< Read I/Q data from this file instead of the SDR, if not empty */
+      std::string write_sample_file;  /**< Write the received I/Q data to this file, if not empty */
+      uint8_t file_bw = 0;            /**< Channel bandwidth of the sample file, in MHz */
+      int8_t override_nof_prb = -1;   /**< Override the number of PRB received in the MIB, -1 to disable */
+      unsigned log_level = 2;         /**< spdlog level, enables srsRAN PHY debug output if <= 1 */
+      unsigned srs_log_level = 4;     /**< srsRAN log level: 0 = debug, 1 = info, 2 = warn, 3 = error, 4 = none */
+    };
+
+    /**
+     *  Origin of a received IP packet
+     */
+    struct PacketInfo {
+      uint32_t mch_idx = 0;
+      uint32_t lcid = 0;
+      std::string_view tmgi;   /**< TMGI of the MTCH as hex string, empty if not (yet) known from the MCCH */
+      uint32_t tti = 0;        /**< TTI of the transport block the packet was received in */
+      std::chrono::system_clock::time_point received = {};   /**< Reception time of its subframe */
+    };
+
+    /**
+     *  Packet callback. Receives the IP packet and its origin. The data is only valid during the call.
+     *  Called on the delivery thread, in reception order. A slow callback delays all later packets.
+     */
+    typedef std::function<void(const uint8_t* data, size_t size, const PacketInfo& info)> packet_callback_t;
+
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Configuration. Must outlive the Modem.
+     *  @param options Options that are not part of the configuration file
+     */
+    Modem(const libconfig::Config& cfg, const Options& options);
+
+    /**
+     *  Default destructor. Stops the receive chain if it is running.
+     */
+    virtual ~Modem();
+
+    Modem(const Modem&) = delete;
+    Modem& operator=(const Modem&) = delete;
+
+    /**
+     *  Register the packet callback. Must be called before start().
+     */
+    void set_packet_callback(packet_callback_t callback);
+
+    /**
+     *  Open and tune the SDR, and create all components of the receive chain. Returns false on failure.
+     */
+    bool init();
+
+    /**
+     *  Start receiving on a dedicated thread. Must only be called after a successful init().
+     */
+    void start();
+
+    /**
+     *  Receive on the calling thread until stop() is called from another thread. Alternative to start().
+     */
+    void run();
+
+    /**
+     *  Stop receiving. Joins the thread created by start(), which waits for the subframes in flight.
+     */
+    void stop();
+
+    /**
+     *  Print the available SDR devices to stdout
+     */
+    static void list_sdr_devices(const libconfig::Config& cfg);
+
+  private:
+    std::unique_ptr<ReceiveChain> _chain;
+    std::thread _thread;
+};
@@ -0,0 +1,92 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *  Shared memory packet ring: format of the POSIX shared memory object the modem publishes
+ *  its decoded IP packets in (modem.gw.egress = "shm"), for readers on the same host.
+ *
+ *  The object starts with a PacketRingHeader of PACKET_RING_HEADER_SIZE bytes, followed by the
+ *  data area of header.capacity bytes (a power of two). The data area holds a sequence of records,
+ *  each a PacketRingRecord followed by the packet, padded to a multiple of PACKET_RING_ALIGN bytes.
+ *  Positions are 64 bit byte counts since the ring was created, the offset of a position in the
+ *  data area is position & (capacity - 1). A record never wraps around the end of the data area:
+ *  if it does not fit, the producer fills the rest of the area with a record flagged
+ *  PACKET_RING_FLAG_PADDING and starts over at offset 0.
+ *
+ *  There is one producer and any number of readers. The producer never waits for a reader, every
+ *  reader keeps its own position in its own memory, and needs only read access to the object:
+ *
+ *   - write_pos is the end of the last complete record. Records before it can be read.
+ *   - reclaim_pos is raised before the producer overwrites old data. A record at a position
+ *     below reclaim_pos may be (partially) overwritten. A reader checks it after reading a record
+ *     (with an acquire fence in between), and discards what it read if its position is below.
+ *   - notify is incremented whenever write_pos advances, and can be waited on with FUTEX_WAIT.
+ *
+ *  When the modem exits it sets state to PACKET_RING_STATE_CLOSED. On the next start it creates a
+ *  new object under the same name, readers have to map it again. All fields are in host byte order.
+ */
+
+constexpr uint32_t PACKET_RING_MAGIC = 0x5250424d;        // "MBPR"
+constexpr uint16_t PACKET_RING_VERSION = 1;
+constexpr uint32_t PACKET_RING_HEADER_SIZE = 4096;
+constexpr uint32_t PACKET_RING_ALIGN = 32;
+
+constexpr uint32_t PACKET_RING_STATE_RUNNING = 1;
+constexpr uint32_t PACKET_RING_STATE_CLOSED = 2;
+
+constexpr uint32_t PACKET_RING_FLAG_PADDING = 1;          // No packet, skip to the start of the data area
+
+/**
+ *  Ring header, at offset 0 of the shared memory object
+ */
+struct PacketRingHeader {
+  uint32_t magic;                       /**< PACKET_RING_MAGIC, written last when the ring is created */
+  uint16_t version;                     /**< PACKET_RING_VERSION */
+  uint16_t header_size;                 /**< Offset of the data area, PACKET_RING_HEADER_SIZE */
+  uint64_t capacity;                    /**< Size of the data area in bytes, a power of two */
+  std::atomic<uint32_t> state;          /**< PACKET_RING_STATE_* */
+
+  alignas(64) std::atomic<uint64_t> write_pos;
+  alignas(64) std::atomic<uint64_t> reclaim_pos;
+  alignas(64) std::atomic<uint32_t> notify;
+};
+
+/**
+ *  Record header. The packet follows immediately.
+ */
+struct PacketRingRecord {
+  uint32_t size;                        /**< Size of the record including this header and the padding */
+  uint32_t length;                      /**< Packet length in bytes */
+  uint32_t flags;                       /**< PACKET_RING_FLAG_* */
+  uint16_t mch_idx;                     /**< MCH the packet was received on */
+  uint16_t lcid;                        /**< Logical channel the packet was received on */
+  uint64_t timestamp_ns;                /**< Time of publishing, CLOCK_REALTIME */
+  uint64_t reserved;
+};
+
+static_assert(sizeof(PacketRingHeader) <= PACKET_RING_HEADER_SIZE, "PacketRingHeader too large");
+static_assert(sizeof(PacketRingRecord) == PACKET_RING_ALIGN, "PacketRingRecord must be one alignment unit");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory atomics must be lock free");
@@ -0,0 +1,153 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "PacketRingReader.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <ctime>
+
+PacketRingReader::~PacketRingReader() {
+  close();
+}
+
+auto PacketRingReader::open(const std::string& name) -> bool {
+  close();
+
+  int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st = {};
+  if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < PACKET_RING_HEADER_SIZE) {
+    ::close(fd);
+    return false;
+  }
+  _map_size = static_cast<size_t>(st.st_size);
+  void* map = mmap(nullptr, _map_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  _header = static_cast<const PacketRingHeader*>(map);
+  bool valid = _header->magic == PACKET_RING_MAGIC;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  valid = valid && _header->version == PACKET_RING_VERSION &&
+    _header->header_size + _header->capacity == _map_size &&
+    _header->capacity > 0 && (_header->capacity & (_header->capacity - 1)) == 0;
+  if (!valid) {
+    munmap(map, _map_size);
+    _header = nullptr;
+    return false;
+  }
+
+  _data = static_cast<const uint8_t*>(map) + _header->header_size;
+  _capacity = _header->capacity;
+  _pos = _header->write_pos.load(std::memory_order_acquire);
+  return true;
+}
+
+void PacketRingReader::close() {
+  if (_header != nullptr) {
+    munmap(const_cast<PacketRingHeader*>(_header), _map_size);  // NOLINT
+    _header = nullptr;
+    _data = nullptr;
+  }
+}
+
+void PacketRingReader::resync() {
+  _overruns++;
+  _pos = _header->write_pos.load(std::memory_order_acquire);
+}
+
+auto PacketRingReader::next(Packet& packet) -> bool {
+  if (_header == nullptr) {
+    return false;
+  }
+  for (;;) {
+    auto write_pos = _header->write_pos.load(std::memory_order_acquire);
+    if (_pos == write_pos) {
+      return false;
+    }
+    if (write_pos - _pos > _capacity || _header->reclaim_pos.load(std::memory_order_acquire) > _pos) {
+      resync();
+      continue;
+    }
+
+    auto record = reinterpret_cast<const PacketRingRecord*>(_data + (_pos & (_capacity - 1)));
+    PacketRingRecord hdr = *record;
+    // The copy of the header is only valid if the producer has not started to overwrite it
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_header->reclaim_pos.load(std::memory_order_relaxed) > _pos) {
+      resync();
+      continue;
+    }
+    if (hdr.size < sizeof(PacketRingRecord) || hdr.size % PACKET_RING_ALIGN != 0 ||
+        hdr.size > write_pos - _pos || hdr.length > hdr.size - sizeof(PacketRingRecord)) {
+      resync();
+      continue;
+    }
+
+    auto position = _pos;
+    _pos += hdr.size;
+    if (hdr.flags & PACKET_RING_FLAG_PADDING) {
+      continue;
+    }
+
+    packet.data = reinterpret_cast<const uint8_t*>(record + 1);
+    packet.length = hdr.length;
+    packet.mch_idx = hdr.mch_idx;
+    packet.lcid = hdr.lcid;
+    packet.timestamp_ns = hdr.timestamp_ns;
+    packet.position = position;
+    return true;
+  }
+}
+
+auto PacketRingReader::intact(const Packet& packet) const -> bool {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return _header != nullptr && _header->reclaim_pos.load(std::memory_order_relaxed) <= packet.position;
+}
+
+void PacketRingReader::wait(std::chrono::milliseconds timeout) {
+  if (_header == nullptr) {
+    return;
+  }
+  auto notify = _header->notify.load(std::memory_order_acquire);
+  if (_header->write_pos.load(std::memory_order_acquire) != _pos || closed()) {
+    return;
+  }
+  struct timespec ts = {};
+  ts.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+  ts.tv_nsec = static_cast<long>((timeout.count() % 1000) * 1000000);  // NOLINT
+  // Returns immediately if notify has changed since it was read above
+  syscall(SYS_futex, &_header->notify, FUTEX_WAIT, notify, &ts, nullptr, 0);
+}
+
+auto PacketRingReader::closed() const -> bool {
+  return _header == nullptr || _header->state.load(std::memory_order_acquire) == PACKET_RING_STATE_CLOSED;
+}
@@ -0,0 +1,115 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "PacketRing.h"
+
+/**
+ *  Reader for the modem's shared memory packet ring (modem.gw.egress = "shm").
+ *
+ *  Maps the ring read-only and returns the packets in place, without copying them. A reader
+ *  starts at the newest packet and never slows down the modem: if it falls behind by more than
+ *  the ring size, the packets in between are lost and counted as an overrun.
+ *
+ *  A returned packet points into the ring and stays readable until the producer wraps around to
+ *  it. Call intact() after using the packet's data to check it was not overwritten in the meantime.
+ *  One reader object must only be used from one thread. Any number of readers can read the same ring.
+ */
+class PacketRingReader {
+  public:
+    /**
+     *  A packet in the ring
+     */
+    struct Packet {
+      const uint8_t* data = nullptr;
+      uint32_t length = 0;
+      uint16_t mch_idx = 0;
+      uint16_t lcid = 0;
+      uint64_t timestamp_ns = 0;    /**< Time of publishing, CLOCK_REALTIME */
+      uint64_t position = 0;        /**< Position of the record in the ring */
+    };
+
+    /**
+     *  Default constructor.
+     */
+    PacketRingReader() = default;
+
+    /**
+     *  Default destructor. Unmaps the ring.
+     */
+    virtual ~PacketRingReader();
+
+    PacketRingReader(const PacketRingReader&) = delete;
+    PacketRingReader& operator=(const PacketRingReader&) = delete;
+
+    /**
+     *  Map the ring. Returns false if it does not exist (yet) or has an unsupported format.
+     *
+     *  @param name Name of the shared memory object, modem.gw.shm.name
+     */
+    bool open(const std::string& name);
+
+    /**
+     *  Unmap the ring
+     */
+    void close();
+
+    /**
+     *  Get the next packet. Returns false if there is none.
+     */
+    bool next(Packet& packet);
+
+    /**
+     *  true if the data of the passed packet has not been overwritten since it was returned by next()
+     */
+    bool intact(const Packet& packet) const;
+
+    /**
+     *  Wait until new packets are published, the ring is closed or the timeout expires.
+     *  Returns immediately if packets are available.
+     */
+    void wait(std::chrono::milliseconds timeout);
+
+    /**
+     *  true if the modem has closed the ring. Open it again to read from the new one when the modem restarts.
+     */
+    bool closed() const;
+
+    /**
+     *  Number of times the reader fell behind by more than the ring size, and skipped to the newest packet
+     */
+    uint64_t overruns() const { return _overruns; }
+
+  private:
+    void resync();
+
+    const PacketRingHeader* _header = nullptr;
+    const uint8_t* _data = nullptr;
+    size_t _map_size = 0;
+    uint64_t _capacity = 0;
+    uint64_t _pos = 0;
+    uint64_t _overruns = 0;
+};
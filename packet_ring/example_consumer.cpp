@@ -0,0 +1,94 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+// Example consumer for the shared memory packet ring.
+//
+// Reads all packets the modem publishes (modem.gw.egress = "shm") and prints the packet and data
+// rate once per second. Reattaches to the ring when the modem restarts.
+//
+// Usage: packet_ring_consumer [shm name]
+
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "PacketRingReader.h"
+
+static std::atomic<bool> running = {true};
+
+static void on_signal(int /*signum*/) {
+  running = false;
+}
+
+auto main(int argc, char** argv) -> int {
+  std::string name = argc > 1 ? argv[1] : "/5gmag-rt-modem-packets";
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  PacketRingReader reader;
+  PacketRingReader::Packet packet;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  uint64_t udp = 0;
+  uint64_t torn = 0;
+  auto report = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+  while (running) {
+    if (reader.closed()) {
+      if (!reader.open(name)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        continue;
+      }
+      printf("Attached to %s\n", name.c_str());
+    }
+
+    reader.wait(std::chrono::milliseconds(100));
+    while (reader.next(packet)) {
+      // The packet is read in place. Anything taken from it is only valid if it is still intact afterwards.
+      auto ip_hdr = reinterpret_cast<const iphdr*>(packet.data);
+      bool is_udp = packet.length >= sizeof(iphdr) + sizeof(udphdr) && ip_hdr->version == 4 &&
+        ip_hdr->protocol == IPPROTO_UDP;
+      if (!reader.intact(packet)) {
+        torn++;
+        continue;
+      }
+      packets++;
+      bytes += packet.length;
+      udp += is_udp ? 1 : 0;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= report) {
+      printf("%" PRIu64 " packets/s (%" PRIu64 " UDP), %.2f Mbit/s, %" PRIu64 " overruns, "
+          "%" PRIu64 " overwritten while reading\n",
+          packets, udp, bytes * 8 / 1e6, reader.overruns(), torn);
+      packets = bytes = udp = 0;
+      report = now + std::chrono::seconds(1);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,201 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+ *  Fixed-capacity lock-free multi-producer / multi-consumer queue.
+ *
+ *  All cells are allocated once in the constructor, pushing and popping never allocate.
+ *  Each cell carries a sequence number that tells producers and consumers whether
+ *  it is free for writing or holds a value for reading (D. Vyukov's bounded MPMC queue).
+ *  The capacity is rounded up to the next power of two.
+ */
+template <class T>
+class BoundedMpmcQueue {
+  public:
+    explicit BoundedMpmcQueue(size_t capacity)
+      : _mask(round_up(capacity) - 1)
+      , _cells(new Cell[_mask + 1])
+    {
+      for (size_t i = 0; i <= _mask; i++) {
+        _cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+    /**
+     *  Enqueue a value. Returns false if the queue is full.
+     */
+    bool try_push(const T& value) {
+      Cell* cell;
+      size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+      for (;;) {
+        cell = &_cells[pos & _mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+          if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = _enqueue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      cell->value = value;
+      cell->seq.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     *  Dequeue a value. Returns false if the queue is empty.
+     */
+    bool try_pop(T& value) {
+      Cell* cell;
+      size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+      for (;;) {
+        cell = &_cells[pos & _mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+          if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = _dequeue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      value = cell->value;
+      cell->seq.store(pos + _mask + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     *  Approximate number of queued elements
+     */
+    size_t size() const {
+      auto enq = _enqueue_pos.load(std::memory_order_relaxed);
+      auto deq = _dequeue_pos.load(std::memory_order_relaxed);
+      return enq > deq ? enq - deq : 0;
+    }
+
+    size_t capacity() const { return _mask + 1; }
+
+  private:
+    static size_t round_up(size_t n) {
+      size_t c = 2;
+      while (c < n) {
+        c <<= 1;
+      }
+      return c;
+    }
+
+    struct Cell {
+      std::atomic<size_t> seq;
+      T value;
+    };
+
+    static constexpr size_t kCacheLine = 64;
+
+    const size_t _mask;
+    std::unique_ptr<Cell[]> _cells;
+
+    alignas(kCacheLine) std::atomic<size_t> _enqueue_pos = {0};
+    alignas(kCacheLine) std::atomic<size_t> _dequeue_pos = {0};
+};
+
+/**
+ *  Fixed-capacity lock-free single-producer / single-consumer queue.
+ *
+ *  Only one thread may push and only one thread may pop at any time. Producer and
+ *  consumer indices live on separate cache lines. The capacity is rounded up to the next power of two.
+ */
+template <class T>
+class SpscQueue {
+  public:
+    explicit SpscQueue(size_t capacity)
+      : _mask(round_up(capacity) - 1)
+      , _cells(new T[_mask + 1])
+    {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     *  Enqueue a value. Returns false if the queue is full.
+     */
+    bool try_push(const T& value) {
+      size_t head = _head.load(std::memory_order_relaxed);
+      if (head - _tail.load(std::memory_order_acquire) > _mask) {
+        return false;
+      }
+      _cells[head & _mask] = value;
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     *  Dequeue a value. Returns false if the queue is empty.
+     */
+    bool try_pop(T& value) {
+      size_t tail = _tail.load(std::memory_order_relaxed);
+      if (tail == _head.load(std::memory_order_acquire)) {
+        return false;
+      }
+      value = _cells[tail & _mask];
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     *  Approximate number of queued elements
+     */
+    size_t size() const {
+      return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return _mask + 1; }
+
+  private:
+    static size_t round_up(size_t n) {
+      size_t c = 2;
+      while (c < n) {
+        c <<= 1;
+      }
+      return c;
+    }
+
+    static constexpr size_t kCacheLine = 64;
+
+    const size_t _mask;
+    std::unique_ptr<T[]> _cells;
+
+    alignas(kCacheLine) std::atomic<size_t> _head = {0};
+    alignas(kCacheLine) std::atomic<size_t> _tail = {0};
+};
@@ -18,27 +18,14 @@
 //
 
 #include "CasFrameProcessor.h"
-#include "spdlog/spdlog.h"
-
-
-auto CasFrameProcessor::init() -> bool {
-  _signal_buffer_max_samples = 3 * SRSRAN_SF_LEN_PRB(MAX_PRB);
 
-  for (auto ch = 0; ch < _rx_channels; ch++) {
-    _signal_buffer_rx[ch] = srsran_vec_cf_malloc(_signal_buffer_max_samples);
-    if (!_signal_buffer_rx[ch]) {
-      spdlog::error("Could not allocate regular DL signal buffer\n");
-      return false;
-    }
-  }
+#include <algorithm>
+#include <chrono>
 
-  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, MAX_PRB, _rx_channels)) {
-    spdlog::error("Could not init ue_dl\n");
-    return false;;
-  }
+#include "spdlog/spdlog.h"
 
-  srsran_softbuffer_rx_init(&_softbuffer, 100);
 
+auto CasFrameProcessor::init() -> bool {
   _ue_dl_cfg.snr_to_cqi_offset = 0;
 
   for (auto & i : _data) {
@@ -67,7 +54,8 @@ auto CasFrameProcessor::init() -> bool {
   _ue_dl_cfg.cfg.pdsch.decoder_type       = SRSRAN_MIMO_DECODER_MMSE;
   _ue_dl_cfg.cfg.pdsch.softbuffers.rx[0] = &_softbuffer;
 
-  return true;
+  // Start out with buffers for the narrowest carrier. They are resized once the cell is known.
+  return set_nof_prb(MIN_PRB);
 }
 
 CasFrameProcessor::~CasFrameProcessor() {
@@ -76,16 +64,103 @@ CasFrameProcessor::~CasFrameProcessor() {
       free(i);
     }
   }
-  srsran_softbuffer_rx_free(&_softbuffer);
-  srsran_ue_dl_free(&_ue_dl);
+  free_buffers();
+}
+
+auto CasFrameProcessor::set_nof_prb(uint32_t nof_prb) -> bool {
+  if (nof_prb == _nof_prb) {
+    return true;
+  }
+  free_buffers();
+
+  _signal_buffer_max_samples = 3 * SRSRAN_SF_LEN_PRB(nof_prb);
+  for (unsigned ch = 0; ch < _rx_channels; ch++) {
+    _signal_buffer_rx[ch] = srsran_vec_cf_malloc(_signal_buffer_max_samples);
+    if (!_signal_buffer_rx[ch]) {
+      spdlog::error("Could not allocate regular DL signal buffer\n");
+      free_buffers();
+      return false;
+    }
+  }
+
+  // srsran_ue_dl_init cleans up after itself if it fails
+  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, nof_prb, _rx_channels)) {
+    spdlog::error("Could not init ue_dl\n");
+    free_buffers();
+    return false;
+  }
+  _ue_dl_initialized = true;
+
+  // srsran_softbuffer_rx_free releases a partially initialized softbuffer as well
+  _softbuffer_initialized = true;
+  if (srsran_softbuffer_rx_init(&_softbuffer, nof_prb) != 0) {
+    spdlog::error("Could not init softbuffer\n");
+    free_buffers();
+    return false;
+  }
+
+  if (!_pdsch_decoder.apply(&_ue_dl.pdsch.dl_sch, true)) {
+    spdlog::error("Could not init PDSCH turbo decoder");
+    free_buffers();
+    return false;
+  }
+  // PDSCH demodulates to 8 bit LLRs if the decoder takes them
+  _ue_dl.pdsch.llr_is_8bit = _pdsch_decoder.llr_8bit();
+
+  _nof_prb = nof_prb;
+  return true;
+}
+
+void CasFrameProcessor::free_buffers() {
+  // Each step is undone separately, set_nof_prb calls this to unwind a partial allocation
+  if (_softbuffer_initialized) {
+    srsran_softbuffer_rx_free(&_softbuffer);
+    _softbuffer_initialized = false;
+  }
+  if (_ue_dl_initialized) {
+    srsran_ue_dl_free(&_ue_dl);
+    _ue_dl_initialized = false;
+  }
+  for (auto& buffer : _signal_buffer_rx) {
+    free(buffer);
+    buffer = nullptr;
+  }
+  _signal_buffer_max_samples = 0;
+  _nof_prb = 0;
+}
+
+auto CasFrameProcessor::memory_footprint() const -> size_t {
+  return static_cast<size_t>(_rx_channels) * _signal_buffer_max_samples * sizeof(cf_t) +
+    static_cast<size_t>(_softbuffer.max_cb) * SOFTBUFFER_SIZE * sizeof(int16_t);
 }
 
 void CasFrameProcessor::set_cell(srsran_cell_t cell) {
+  // Wait for a subframe that is still being processed, the buffers may be reallocated
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  // With a wider MBSFN carrier, the CAS subframes are received at the MBSFN sample rate
+  auto nof_prb = std::max<uint32_t>(cell.nof_prb, cell.mbsfn_prb);
+  if (nof_prb != _nof_prb) {
+    auto start = std::chrono::steady_clock::now();
+    if (!set_nof_prb(nof_prb)) {
+      spdlog::error("Could not resize CAS processor for {} PRB", nof_prb);
+      return;
+    }
+    spdlog::info("CAS processor: buffers for {} PRB, {} kB, set up in {} ms", nof_prb, memory_footprint() / 1024,
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+
   _cell = cell;
   spdlog::debug("CAS processor setting cell ({} PRB / {} MBSFN PRB).", cell.nof_prb, cell.mbsfn_prb);
   srsran_ue_dl_set_cell(&_ue_dl, cell);
 }
 
+void CasFrameProcessor::skip(uint32_t tti) {
+  spdlog::debug("CAS subframe {} is late, skipping", tti);
+  _rest._late_drops.cas++;
+  unlock();
+}
+
 auto CasFrameProcessor::process(uint32_t tti) -> bool {
   _sf_cfg.tti = tti;
   _sf_cfg.sf_type = SRSRAN_SF_NORM;
@@ -108,6 +183,10 @@ auto CasFrameProcessor::process(uint32_t tti) -> bool {
   // Feedback the CFO from CE to the Phy
   _phy.set_cfo_from_channel_estimation(_ue_dl.chest_res.cfo);
 
+  auto iterations = _pdsch_decoder.iterations(_ue_dl.chest_res.snr_db);
+  _ue_dl_cfg.cfg.pdsch.max_nof_iterations = iterations;
+  _rest._pdsch.iteration_cap = iterations;
+
   // Try to decode DCIs from PDCCH
   srsran_dci_dl_t dci[SRSRAN_MAX_CARRIERS] = {};    // NOLINT
   int nof_grants = srsran_ue_dl_find_dl_dci(&_ue_dl, &_sf_cfg, &_ue_dl_cfg, _cell.mbms_dedicated ? SRSRAN_SIRNTI_MBMS_DEDICATED : SRSRAN_SIRNTI, dci);
@@ -144,7 +223,10 @@ auto CasFrameProcessor::process(uint32_t tti) -> bool {
     _rest._pdsch.SetData(pdsch_data());
 
     // Decode PDSCH..
+    auto start = std::chrono::steady_clock::now();
     auto ret = srsran_ue_dl_decode_pdsch(&_ue_dl, &_sf_cfg, &_ue_dl_cfg.cfg.pdsch, pdsch_res);
+    _rest._pdsch.add_decode_time(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start).count());
     if (ret) {
       spdlog::error("Error decoding PDSCH\n");
       _rest._pdsch.errors++;
@@ -158,7 +240,10 @@ auto CasFrameProcessor::process(uint32_t tti) -> bool {
       }
     }
   }
-    _mutex.unlock();
+
+  // Set the rx params for CAS in the REST API handler
+  _rest.add_cinr_value(cinr_db());
+  _mutex.unlock();
   return true;
 }
 
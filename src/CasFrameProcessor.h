@@ -20,11 +20,13 @@
 #pragma once
 
 #include <cstdint>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <thread>
 #include "srsran/srsran.h"
 #include "srsran/rlc/rlc.h"
+#include "DecoderConfig.h"
 #include "Phy.h"
 #include "RestHandler.h"
 #include <libconfig.h++>
@@ -50,6 +52,7 @@ class CasFrameProcessor {
      , _rest(rest)
      , _rlc(rlc)
      , _rx_channels(rx_channels)
+     , _pdsch_decoder(cfg, "pdsch")
      {}
 
    /**
@@ -71,6 +74,14 @@ class CasFrameProcessor {
     */
    bool process(uint32_t tti);
 
+   /**
+    *  Drop the subframe in the signal buffer without processing it, because it is already too late.
+    *  Unlocks the processor.
+    *
+    *  @param tti TTI of the subframe the data belongs to
+    */
+   void skip(uint32_t tti);
+
    /**
     *  Set the parameters for the cell (Nof PRB, etc).
     * 
@@ -78,6 +89,11 @@ class CasFrameProcessor {
     */
    void set_cell(srsran_cell_t cell);
 
+   /**
+    *  Memory held by the signal buffers and softbuffer, in bytes
+    */
+   size_t memory_footprint() const;
+
    /**
     *  Get a handle of the signal buffer to store samples for processing in
     */
@@ -112,6 +128,9 @@ class CasFrameProcessor {
    float cinr_db() { return _ue_dl.chest_res.snr_db; }
 
  private:
+   bool set_nof_prb(uint32_t nof_prb);
+   void free_buffers();
+
    const libconfig::Config& _cfg;
     srsran::rlc& _rlc;
     Phy& _phy;
@@ -119,8 +138,11 @@ class CasFrameProcessor {
 
     cf_t*    _signal_buffer_rx[SRSRAN_MAX_PORTS] = {};
     uint32_t _signal_buffer_max_samples          = 0;
+    uint32_t _nof_prb                            = 0;  /**< Number of PRB the buffers are allocated for */
+    bool     _ue_dl_initialized                  = false;
+    bool     _softbuffer_initialized             = false;
 
-    srsran_softbuffer_rx_t _softbuffer;
+    srsran_softbuffer_rx_t _softbuffer = {};
     uint8_t* _data[SRSRAN_MAX_CODEWORDS];
 
     srsran_ue_dl_t     _ue_dl     = {};
@@ -130,4 +152,6 @@ class CasFrameProcessor {
     srsran_cell_t _cell;
     std::mutex _mutex;
     unsigned _rx_channels;
+
+    DecoderConfig _pdsch_decoder;
 };
@@ -0,0 +1,73 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "Checksum.h"
+
+#include <netinet/in.h>
+
+#include <cstring>
+
+auto Checksum::add(const void* data, size_t len, uint64_t sum) -> uint64_t {
+  auto ptr = static_cast<const uint8_t*>(data);
+  uint64_t word = 0;
+  while (len >= sizeof(word)) {
+    memcpy(&word, ptr, sizeof(word));
+    sum += word;
+    sum += (sum < word) ? 1 : 0;   // end-around carry
+    ptr += sizeof(word);
+    len -= sizeof(word);
+  }
+  if (len > 0) {
+    // Zero padded, which also places an odd last byte in the high half of its 16 bit word
+    word = 0;
+    memcpy(&word, ptr, len);
+    sum += word;
+    sum += (sum < word) ? 1 : 0;
+  }
+  return sum;
+}
+
+auto Checksum::fold(uint64_t sum) -> uint16_t {
+  sum = (sum & 0xffffffffULL) + (sum >> 32);
+  sum = (sum & 0xffffffffULL) + (sum >> 32);
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return static_cast<uint16_t>(sum);
+}
+
+auto Checksum::ip_header(const iphdr* ip_hdr) -> uint16_t {
+  // Sum the whole header, and take the check field out again by adding its complement
+  auto sum = add(ip_hdr, 4U * ip_hdr->ihl);
+  sum += static_cast<uint16_t>(~ip_hdr->check);
+  return static_cast<uint16_t>(~fold(sum));
+}
+
+auto Checksum::udp_pseudo_header(const iphdr* ip_hdr, uint16_t udp_len) -> uint64_t {
+  return static_cast<uint64_t>(ip_hdr->saddr) + ip_hdr->daddr + htons(IPPROTO_UDP) + udp_len;
+}
+
+auto Checksum::udp(const iphdr* ip_hdr, const udphdr* udp_hdr, size_t len) -> uint16_t {
+  auto sum = udp_pseudo_header(ip_hdr, htons(static_cast<uint16_t>(len)));
+  sum = add(udp_hdr, len, sum);
+  sum += static_cast<uint16_t>(~udp_hdr->check);
+  auto check = static_cast<uint16_t>(~fold(sum));
+  // A computed checksum of zero is transmitted as all ones, zero means "no checksum"
+  return check == 0 ? 0xffff : check;
+}
@@ -0,0 +1,74 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *  Internet checksums (RFC 1071) of IPv4 and UDP headers.
+ *
+ *  The one's complement sum is accumulated over 64 bit words with end-around carry, which the
+ *  compiler turns into add-with-carry instructions, and folded to 16 bits at the end. All sums are
+ *  in memory (network) byte order, so the result can be stored into the header as is.
+ */
+class Checksum {
+  public:
+    /**
+     *  Add data to a partial one's complement sum. Partial sums can only be chained if len is even.
+     *
+     *  @param data Start of the data
+     *  @param len Length in bytes
+     *  @param sum Partial sum to continue from
+     */
+    static uint64_t add(const void* data, size_t len, uint64_t sum = 0);
+
+    /**
+     *  Fold a partial sum to 16 bits. The result is not complemented.
+     */
+    static uint16_t fold(uint64_t sum);
+
+    /**
+     *  Header checksum of an IPv4 header, including options. The current value of the check field is ignored.
+     *  The header must be complete (4 * ihl bytes).
+     */
+    static uint16_t ip_header(const iphdr* ip_hdr);
+
+    /**
+     *  Partial sum of the UDP pseudo header
+     *
+     *  @param ip_hdr IPv4 header
+     *  @param udp_len UDP length in network byte order
+     */
+    static uint64_t udp_pseudo_header(const iphdr* ip_hdr, uint16_t udp_len);
+
+    /**
+     *  Checksum of a UDP datagram. The current value of the check field is ignored.
+     *
+     *  @param ip_hdr IPv4 header
+     *  @param udp_hdr UDP header, followed by the payload
+     *  @param len Length of UDP header and payload in bytes
+     */
+    static uint16_t udp(const iphdr* ip_hdr, const udphdr* udp_hdr, size_t len);
+};
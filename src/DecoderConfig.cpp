@@ -0,0 +1,101 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "DecoderConfig.h"
+
+#include <algorithm>
+#include <map>
+
+#include "spdlog/spdlog.h"
+
+static const std::map<std::string, srsran_tdec_impl_type_t> kImplementations = {
+  { "auto", SRSRAN_TDEC_AUTO },
+  { "generic", SRSRAN_TDEC_GENERIC },
+  { "sse", SRSRAN_TDEC_SSE },
+  { "sse_window", SRSRAN_TDEC_SSE_WINDOW },
+  { "avx_window", SRSRAN_TDEC_AVX_WINDOW },
+  { "sse8_window", SRSRAN_TDEC_SSE8_WINDOW },
+  { "avx8_window", SRSRAN_TDEC_AVX8_WINDOW },
+};
+
+DecoderConfig::DecoderConfig(const libconfig::Config& cfg, const std::string& channel)
+  : _channel(channel) {
+  auto path = "modem.phy.decoder." + channel + ".";
+  cfg.lookupValue(path + "implementation", _implementation);
+  cfg.lookupValue(path + "llr_8bit", _llr_8bit);
+  cfg.lookupValue(path + "max_iterations", _max_iterations);
+  // Without min_iterations, the cap does not depend on the SNR
+  if (!cfg.lookupValue(path + "min_iterations", _min_iterations)) {
+    _min_iterations = _max_iterations;
+  }
+  cfg.lookupValue(path + "low_snr_db", _low_snr_db);
+  cfg.lookupValue(path + "high_snr_db", _high_snr_db);
+
+  _max_iterations = std::max(_max_iterations, 1U);
+  _min_iterations = std::min(std::max(_min_iterations, 1U), _max_iterations);
+
+  if (kImplementations.find(_implementation) == kImplementations.end()) {
+    spdlog::error("Unknown {} turbo decoder implementation {}, using auto", channel, _implementation);
+    _implementation = "auto";
+  }
+}
+
+auto DecoderConfig::apply(srsran_sch_t* sch, bool llr_8bit_supported) -> bool {
+  if (_llr_8bit && !llr_8bit_supported) {
+    spdlog::warn("8 bit LLRs are not supported for {}, using 16 bit", _channel);
+    _llr_8bit = false;
+  }
+
+  // The 8 bit decoders only take 8 bit LLRs, and vice versa
+  bool impl_8bit = _implementation == "sse8_window" || _implementation == "avx8_window";
+  if (_implementation != "auto" && impl_8bit != _llr_8bit) {
+    spdlog::warn("{} turbo decoder {} does not match {} bit LLRs, using auto", _channel, _implementation,
+        _llr_8bit ? 8 : 16);
+    _implementation = "auto";
+  }
+
+  sch->llr_is_8bit = _llr_8bit;
+  if (_implementation == "auto") {
+    return true;
+  }
+
+  srsran_tdec_free(&sch->decoder);
+  if (srsran_tdec_init_manual(&sch->decoder, SRSRAN_TCOD_MAX_LEN_CB, kImplementations.at(_implementation)) != 0) {
+    spdlog::error("{} turbo decoder {} is not available in this build, using auto", _channel, _implementation);
+    _implementation = "auto";
+    return srsran_tdec_init(&sch->decoder, SRSRAN_TCOD_MAX_LEN_CB) == 0;
+  }
+  return true;
+}
+
+auto DecoderConfig::iterations(float snr_db) const -> uint32_t {
+  if (snr_db <= _low_snr_db || _high_snr_db <= _low_snr_db) {
+    return snr_db <= _low_snr_db ? _min_iterations : _max_iterations;
+  }
+  if (snr_db >= _high_snr_db) {
+    return _max_iterations;
+  }
+  auto span = static_cast<float>(_max_iterations - _min_iterations);
+  return _min_iterations + static_cast<uint32_t>(span * (snr_db - _low_snr_db) / (_high_snr_db - _low_snr_db) + 0.5F);
+}
+
+auto DecoderConfig::description() const -> std::string {
+  return _implementation + ", " + (_llr_8bit ? "8" : "16") + " bit LLR, " + std::to_string(_min_iterations) +
+    "-" + std::to_string(_max_iterations) + " iterations";
+}
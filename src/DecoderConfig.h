@@ -0,0 +1,73 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <libconfig.h++>
+#include "srsran/srsran.h"
+
+/**
+ *  Turbo decoder settings for one channel type (PDSCH, MCCH or MTCH), read from
+ *  modem.phy.decoder.<channel>.
+ *
+ *  Selects the srsRAN turbo decoder implementation (SIMD width, 16 or 8 bit LLRs), and the
+ *  iteration cap. The cap is max_iterations by default. If min_iterations is configured lower,
+ *  the cap is scaled with the SNR of the subframe between min_iterations (at or below low_snr_db,
+ *  where extra iterations rarely rescue a TB) and max_iterations (at or above high_snr_db).
+ */
+class DecoderConfig {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param channel Channel name: "pdsch", "mcch" or "mtch"
+     */
+    DecoderConfig(const libconfig::Config& cfg, const std::string& channel);
+
+    /**
+     *  Replace the turbo decoder of the passed SCH by the configured implementation.
+     *
+     *  @param sch The shared channel to configure
+     *  @param llr_8bit_supported true if the channel can produce 8 bit LLRs
+     */
+    bool apply(srsran_sch_t* sch, bool llr_8bit_supported);
+
+    /**
+     *  Iteration cap for a subframe with the passed SNR
+     */
+    uint32_t iterations(float snr_db) const;
+
+    /**
+     *  Human readable description of the settings
+     */
+    std::string description() const;
+
+    bool llr_8bit() const { return _llr_8bit; }
+
+  private:
+    std::string _channel;
+    std::string _implementation = "auto";
+    bool _llr_8bit = false;
+    uint32_t _min_iterations = 8;
+    uint32_t _max_iterations = 8;
+    float _low_snr_db = 0.0;
+    float _high_snr_db = 10.0;
+};
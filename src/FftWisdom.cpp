@@ -0,0 +1,67 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "FftWisdom.h"
+
+#include <fftw3.h>
+
+#include <cstdlib>
+#include <memory>
+
+#include "spdlog/spdlog.h"
+
+FftWisdom::FftWisdom(const libconfig::Config& cfg) {
+  cfg.lookupValue("modem.phy.fft_wisdom_file", _path);
+  if (_path.empty()) {
+    spdlog::info("FFTW wisdom file not configured");
+    return;
+  }
+
+  _loaded = fftwf_import_wisdom_from_filename(_path.c_str()) != 0;
+  if (_loaded) {
+    spdlog::info("Loaded FFTW wisdom from {}", _path);
+  } else {
+    spdlog::info("No FFTW wisdom loaded from {}, FFT plans will be measured", _path);
+  }
+
+  std::unique_ptr<char, decltype(&free)> wisdom(fftwf_export_wisdom_to_string(), &free);
+  if (wisdom) {
+    _saved = wisdom.get();
+  }
+}
+
+void FftWisdom::save() {
+  if (_path.empty() || !_planned) {
+    return;
+  }
+  _planned = false;
+
+  std::unique_ptr<char, decltype(&free)> wisdom(fftwf_export_wisdom_to_string(), &free);
+  if (!wisdom || _saved == wisdom.get()) {
+    return;
+  }
+
+  // Only retried once there are new plans, to not repeat the warning on every call
+  _saved = wisdom.get();
+  if (fftwf_export_wisdom_to_filename(_path.c_str()) == 0) {
+    spdlog::warn("Could not write FFTW wisdom to {}", _path);
+    return;
+  }
+  spdlog::info("Saved FFTW wisdom to {}", _path);
+}
@@ -0,0 +1,86 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <libconfig.h++>
+
+/**
+ *  Persists FFTW wisdom across restarts.
+ *
+ *  srsRAN plans its FFTs with FFTW_MEASURE, which takes seconds for the full set of symbol sizes
+ *  of the search, CAS and MBSFN processors. With the wisdom of a previous run loaded, planning
+ *  the same sizes takes milliseconds. The wisdom is loaded from the configured file at startup,
+ *  and written back when it has grown, so a run that ends in a crash still leaves it behind.
+ *  Exporting the wisdom is not free, so it is only checked for growth after note_planning() has been called.
+ *
+ *  All FFT plans are created on the main thread. The methods of this class must only be called from there as well.
+ */
+class FftWisdom {
+  public:
+    /**
+     *  Default constructor. Loads the wisdom file, if configured.
+     *
+     *  @param cfg Config singleton reference
+     */
+    explicit FftWisdom(const libconfig::Config& cfg);
+
+    /**
+     *  Default destructor.
+     */
+    virtual ~FftWisdom() = default;
+
+    /**
+     *  Write the wisdom file if new plans have been created since it was loaded or last saved.
+     *  Does nothing unless note_planning() or add_planning_time() has been called since the last save.
+     */
+    void save();
+
+    /**
+     *  Note that FFT plans may have been created, e.g. after (re)configuring a processor for a cell
+     */
+    void note_planning() { _planned = true; }
+
+    /**
+     *  Accumulate time spent creating FFT plans, for the startup log
+     */
+    void add_planning_time(std::chrono::microseconds duration) {
+      _planning_time += duration;
+      _planned = true;
+    }
+
+    /**
+     *  Time spent creating FFT plans so far
+     */
+    std::chrono::microseconds planning_time() const { return _planning_time; }
+
+    /**
+     *  true if wisdom has been loaded from the file
+     */
+    bool loaded() const { return _loaded; }
+
+  private:
+    std::string _path;
+    std::string _saved;
+    bool _loaded = false;
+    bool _planned = false;
+    std::chrono::microseconds _planning_time = {};
+};
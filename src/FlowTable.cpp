@@ -0,0 +1,153 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "FlowTable.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cmath>
+
+FlowTable::FlowTable(unsigned nof_mch, unsigned nof_lcid)
+  : _nof_mch(nof_mch)
+  , _nof_lcid(nof_lcid)
+  , _entries(new Entry[static_cast<size_t>(nof_mch) * nof_lcid]) {}
+
+void FlowTable::update(uint32_t mch_idx, uint32_t lcid, uint32_t daddr, uint16_t dport) {
+  if (mch_idx >= _nof_mch || lcid >= _nof_lcid) {
+    return;
+  }
+  auto key = (1ULL << 48) | (static_cast<uint64_t>(dport) << 32) | daddr;
+  auto& entry = _entries[mch_idx * _nof_lcid + lcid];
+  if (entry.key.load(std::memory_order_relaxed) != key) {
+    set(entry, key, daddr, dport);
+  }
+}
+
+void FlowTable::set(Entry& entry, uint64_t key, uint32_t daddr, uint16_t dport) {
+  char addr[INET_ADDRSTRLEN] = "";   // NOLINT
+  inet_ntop(AF_INET, &daddr, addr, sizeof(addr));
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (entry.key.load(std::memory_order_relaxed) != 0) {
+    entry.changes++;
+  }
+  entry.dest = std::string(addr) + ":" + std::to_string(ntohs(dport));
+  entry.key.store(key, std::memory_order_relaxed);
+}
+
+void FlowTable::count(uint32_t mch_idx, uint32_t lcid, uint32_t bytes, uint64_t latency_us) {
+  if (mch_idx >= _nof_mch || lcid >= _nof_lcid) {
+    return;
+  }
+  auto& entry = _entries[mch_idx * _nof_lcid + lcid];
+  // Single writer: no read-modify-write needed, readers see either the old or the new value
+  entry.packets.store(entry.packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  entry.bytes.store(entry.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+
+  unsigned bucket = latency_us == 0 ? 0 : 64 - static_cast<unsigned>(__builtin_clzll(latency_us));
+  auto& counter = entry.latency[std::min(bucket, LATENCY_BUCKETS - 1)];
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void FlowTable::update_rates() {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(_mutex);
+  double seconds = std::chrono::duration<double>(now - _last_rates).count();
+  _last_rates = now;
+  if (seconds <= 0) {
+    return;
+  }
+  for (size_t i = 0; i < static_cast<size_t>(_nof_mch) * _nof_lcid; i++) {
+    auto& entry = _entries[i];
+    auto packets = entry.packets.load(std::memory_order_relaxed);
+    auto bytes = entry.bytes.load(std::memory_order_relaxed);
+    entry.packets_per_s = static_cast<double>(packets - entry.last_packets) / seconds;
+    entry.bits_per_s = static_cast<double>(bytes - entry.last_bytes) * 8 / seconds;
+    entry.last_packets = packets;
+    entry.last_bytes = bytes;
+  }
+}
+
+auto FlowTable::get(const Entry& entry, uint32_t mch_idx, uint32_t lcid) const -> Flow {
+  Flow flow;
+  flow.mch_idx = mch_idx;
+  flow.lcid = lcid;
+  flow.dest = entry.dest;
+  flow.changes = entry.changes;
+  flow.packets = entry.packets.load(std::memory_order_relaxed);
+  flow.bytes = entry.bytes.load(std::memory_order_relaxed);
+  flow.packets_per_s = entry.packets_per_s;
+  flow.bits_per_s = entry.bits_per_s;
+  for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+    flow.latency[i] = entry.latency[i].load(std::memory_order_relaxed);
+  }
+  return flow;
+}
+
+auto FlowTable::dest(uint32_t mch_idx, uint32_t lcid) -> std::string {
+  if (mch_idx >= _nof_mch || lcid >= _nof_lcid) {
+    return "";
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _entries[mch_idx * _nof_lcid + lcid].dest;
+}
+
+auto FlowTable::flow(uint32_t mch_idx, uint32_t lcid) -> Flow {
+  if (mch_idx >= _nof_mch || lcid >= _nof_lcid) {
+    return {};
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  return get(_entries[mch_idx * _nof_lcid + lcid], mch_idx, lcid);
+}
+
+auto FlowTable::snapshot() -> std::vector<Flow> {
+  std::vector<Flow> flows;
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (uint32_t mch_idx = 0; mch_idx < _nof_mch; mch_idx++) {
+    for (uint32_t lcid = 0; lcid < _nof_lcid; lcid++) {
+      const auto& entry = _entries[mch_idx * _nof_lcid + lcid];
+      if (entry.key.load(std::memory_order_relaxed) == 0 && entry.packets.load(std::memory_order_relaxed) == 0) {
+        continue;
+      }
+      flows.push_back(get(entry, mch_idx, lcid));
+    }
+  }
+  return flows;
+}
+
+auto FlowTable::Flow::latency_percentile_us(double fraction) const -> uint64_t {
+  uint64_t total = 0;
+  for (auto count : latency) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  auto target = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total)));
+  uint64_t sum = 0;
+  for (unsigned i = 0; i < LATENCY_BUCKETS - 1; i++) {
+    sum += latency[i];
+    if (sum >= target) {
+      return 1ULL << i;
+    }
+  }
+  return UINT64_MAX;
+}
@@ -0,0 +1,154 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ *  Destination and traffic statistics of the IP packets seen on each (MCH, LCID).
+ *
+ *  The packet path only compares the destination of every UDP packet with the cached one, which
+ *  is a single atomic load. The printable "address:port" string is formatted under the lock only
+ *  when a flow starts or its destination changes. Readers (REST, the periodic log) take the lock
+ *  and get a copy.
+ *
+ *  Packet, byte and stack latency counters are only written by the delivery thread, so they are
+ *  plain relaxed atomic loads and stores without read-modify-write, and never take the lock.
+ *  Packet and bit rates are calculated by update_rates(), once per measurement interval.
+ */
+class FlowTable {
+  public:
+    /**
+     *  Number of stack latency histogram buckets. Bucket i < LATENCY_BUCKETS - 1 counts packets with a
+     *  latency below 2^i us (and at least 2^(i-1) us), the last bucket counts all slower packets.
+     */
+    static const unsigned LATENCY_BUCKETS = 18;
+
+    /**
+     *  Destination and statistics of one flow
+     */
+    struct Flow {
+      uint32_t mch_idx = 0;
+      uint32_t lcid = 0;
+      std::string dest;
+      uint64_t changes = 0;   /**< Number of times the destination has changed */
+      uint64_t packets = 0;
+      uint64_t bytes = 0;
+      double packets_per_s = 0;
+      double bits_per_s = 0;
+      std::array<uint64_t, LATENCY_BUCKETS> latency = {};
+
+      /**
+       *  Upper bound of the stack latency of the passed fraction (0..1) of all packets, in us.
+       *  Returns 0 if there are no packets, and UINT64_MAX if it is in the last bucket.
+       */
+      uint64_t latency_percentile_us(double fraction) const;
+    };
+
+    /**
+     *  Default constructor.
+     *
+     *  @param nof_mch Number of MCHs
+     *  @param nof_lcid Number of LCIDs per MCH
+     */
+    FlowTable(unsigned nof_mch, unsigned nof_lcid);
+
+    /**
+     *  Default destructor.
+     */
+    virtual ~FlowTable() = default;
+
+    FlowTable(const FlowTable&) = delete;
+    FlowTable& operator=(const FlowTable&) = delete;
+
+    /**
+     *  Record the destination of a packet. Must only be called from one thread (the delivery thread).
+     *
+     *  @param mch_idx MCH index
+     *  @param lcid LCID
+     *  @param daddr IPv4 destination address, network byte order
+     *  @param dport UDP destination port, network byte order
+     */
+    void update(uint32_t mch_idx, uint32_t lcid, uint32_t daddr, uint16_t dport);
+
+    /**
+     *  Count a packet. Must only be called from one thread (the delivery thread).
+     *
+     *  @param mch_idx MCH index
+     *  @param lcid LCID
+     *  @param bytes Packet size
+     *  @param latency_us Stack latency of the packet
+     */
+    void count(uint32_t mch_idx, uint32_t lcid, uint32_t bytes, uint64_t latency_us);
+
+    /**
+     *  Calculate the packet and bit rates since the last call. Called once per measurement interval.
+     */
+    void update_rates();
+
+    /**
+     *  Get the destination of a flow as "address:port", or an empty string if no packet has been seen. Thread safe.
+     */
+    std::string dest(uint32_t mch_idx, uint32_t lcid);
+
+    /**
+     *  Get the destination and statistics of a flow. Thread safe.
+     */
+    Flow flow(uint32_t mch_idx, uint32_t lcid);
+
+    /**
+     *  Get all flows that have seen packets. Thread safe.
+     */
+    std::vector<Flow> snapshot();
+
+  private:
+    struct Entry {
+      std::atomic<uint64_t> key = {0};   /**< valid flag | port | address, 0 if unused */
+      std::string dest;
+      uint64_t changes = 0;
+
+      std::atomic<uint64_t> packets = {0};
+      std::atomic<uint64_t> bytes = {0};
+      std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> latency = {};
+
+      // Written by update_rates(), under the lock
+      uint64_t last_packets = 0;
+      uint64_t last_bytes = 0;
+      double packets_per_s = 0;
+      double bits_per_s = 0;
+    };
+
+    void set(Entry& entry, uint64_t key, uint32_t daddr, uint16_t dport);
+    Flow get(const Entry& entry, uint32_t mch_idx, uint32_t lcid) const;
+
+    unsigned _nof_mch;
+    unsigned _nof_lcid;
+    std::unique_ptr<Entry[]> _entries;
+    std::mutex _mutex;
+    std::chrono::steady_clock::time_point _last_rates = std::chrono::steady_clock::now();
+};
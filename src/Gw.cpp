@@ -34,78 +34,161 @@
 #include "spdlog/spdlog.h"
 
 void Gw::write_pdu_mch(uint32_t mch_idx, uint32_t lcid, srsran::unique_byte_buffer_t pdu) {
-  char* err_str = nullptr;
   if (pdu->N_bytes > 2) {
-    spdlog::debug("GW: RX MCH PDU ({} B), MCH idx {}. Stack latency: {} us", pdu->N_bytes, mch_idx,  pdu->get_latency_us().count());
+    auto latency_us = pdu->get_latency_us().count();
+    spdlog::debug("GW: RX MCH PDU ({} B), MCH idx {}. Stack latency: {} us", pdu->N_bytes, mch_idx, latency_us);
+    _phy.flows().count(mch_idx, lcid, pdu->N_bytes, static_cast<uint64_t>(std::max<int64_t>(latency_us, 0)));
 
-    if (_tun_fd < 0) {
+    if (_tun_queues.empty() && !_udp && !_shm && !_egress_none) {
       spdlog::warn("TUN/TAP not up - dropping gw RX message\n");
     } else {
       auto ip_hdr = reinterpret_cast<iphdr*>(pdu->msg);
-      if (ip_hdr->protocol == 17 /*UDP*/) {
-        auto udp_hdr = reinterpret_cast<udphdr*>(pdu->msg + 4U * ip_hdr->ihl);
-        char dest[INET6_ADDRSTRLEN] = "";   // NOLINT
-        inet_ntop(AF_INET, (const void*)&ip_hdr->daddr, dest, sizeof(dest));
-
-        _phy.set_dest_for_lcid(mch_idx, lcid, std::string(dest) + ":" + std::to_string(ntohs(udp_hdr->dest)));
-
-        auto ptr = reinterpret_cast<uint16_t*>(ip_hdr);
-        int32_t sum = 0;
-        sum += *ptr++;   // ihl / version / dscp
-        sum += *ptr++;   // total len
-        sum += *ptr++;   // id
-        sum += *ptr++;   // frag offset
-        sum += *ptr++;   // ttl + protocol
-        ptr++;           // skip checksum
-        sum += *ptr++;   // src
-        sum += *ptr++;   // src
-        sum += *ptr++;   // dst
-        sum += *ptr;     // dst
-
-        sum = (sum >> 16) + (sum & 0xffff);
-        sum += (sum >> 16);
-
-        uint16_t chk = ~sum;
-        if (ip_hdr->check != chk) {
-          spdlog::info("Wrong IP header checksum {}, should be {}. Correcting.", ip_hdr->check, chk);
-          ip_hdr->check = chk;
+      uint32_t ip_hdr_len = 4U * ip_hdr->ihl;
+      if (pdu->N_bytes < sizeof(iphdr) || ip_hdr->version != 4 || ip_hdr->ihl < 5 || ip_hdr_len > pdu->N_bytes) {
+        // Passed on unchanged, the receiving stack decides what to do with it
+        _rest._checksum.malformed++;
+      } else {
+        if (_verify_ip_checksum) {
+          auto check = Checksum::ip_header(ip_hdr);
+          if (ip_hdr->check != check) {
+            spdlog::debug("Wrong IP header checksum {}, should be {}. Correcting.", ip_hdr->check, check);
+            ip_hdr->check = check;
+            _rest._checksum.ip_corrected++;
+          }
+        }
+
+        if (ip_hdr->protocol == IPPROTO_UDP && pdu->N_bytes >= ip_hdr_len + sizeof(udphdr)) {
+          auto udp_hdr = reinterpret_cast<udphdr*>(pdu->msg + ip_hdr_len);
+          _phy.flows().update(mch_idx, lcid, ip_hdr->daddr, udp_hdr->dest);
+
+          if (_fix_udp_checksum) {
+            fix_udp_checksum(ip_hdr, udp_hdr, pdu->N_bytes - ip_hdr_len);
+          }
         }
       }
 
-      _wr_mutex.lock();
-      int n = write(_tun_fd, pdu->msg, pdu->N_bytes);
-      _wr_mutex.unlock();
+      if (_pcap) {
+        _pcap->capture(mch_idx, lcid, _tti, _tti_received, *pdu);
+      }
+
+      if (_packet_callback) {
+        Modem::PacketInfo info;
+        info.mch_idx = mch_idx;
+        info.lcid = lcid;
+        info.tmgi = tmgi(mch_idx, lcid);
+        info.tti = _tti;
+        info.received = _tti_received;
+        _packet_callback(pdu->msg, pdu->N_bytes, info);
+      }
 
-      if (n > 0 && (pdu->N_bytes != static_cast<uint32_t>(n))) {
-        spdlog::warn("DL TUN/TAP short write");
+      if (_udp) {
+        _udp->send(mch_idx, lcid, std::move(pdu));
+        return;
       }
-      if (n == 0) {
-        spdlog::warn("DL TUN/TAP 0 write");
+      if (_shm) {
+        _shm->write(mch_idx, lcid, *pdu);
+        return;
       }
-      if (n < 0) {
-        err_str = strerror(errno);
-        spdlog::warn("DL TUN/TAP write error  {}", err_str);
+
+      if (_egress_none) {
+        return;
       }
+
+      // Every MCH has its own queue and writer, so packets are written in order without a lock
+      _tun_queues[mch_idx % _tun_queues.size()]->add(std::move(pdu));
+    }
+  }
+}
+
+void Gw::fix_udp_checksum(const iphdr* ip_hdr, udphdr* udp_hdr, uint32_t max_len) {
+  if (udp_hdr->check == 0) {
+    return;  // Sent without checksum
+  }
+  uint32_t len = ntohs(udp_hdr->len);
+  if (len < sizeof(udphdr) || len > max_len) {
+    _rest._checksum.malformed++;
+    return;
+  }
+  auto check = Checksum::udp(ip_hdr, udp_hdr, len);
+  if (udp_hdr->check != check) {
+    spdlog::debug("Wrong UDP checksum {}, should be {}. Correcting.", udp_hdr->check, check);
+    udp_hdr->check = check;
+    _rest._checksum.udp_corrected++;
+  }
+}
+
+auto Gw::tmgi(uint32_t mch_idx, uint32_t lcid) -> const std::string& {
+  static const std::string unknown;
+  if (mch_idx >= MAX_MCH || lcid >= SRSRAN_N_MCH_LCIDS) {
+    return unknown;
+  }
+  auto config = _phy.config();
+  if (config->mch_generation != _tmgi_generation) {
+    // New MCCH, or resync: the TMGIs have to be resolved again
+    for (auto& tmgi : _tmgis) {
+      tmgi.clear();
     }
+    _tmgi_generation = config->mch_generation;
+  }
+  auto& tmgi = _tmgis[mch_idx * SRSRAN_N_MCH_LCIDS + lcid];
+  if (tmgi.empty()) {
+    // Not known before the MCCH has been received, try again on the next packet
+    tmgi = config->tmgi(mch_idx, lcid);
   }
+  return tmgi;
 }
 
-Gw::~Gw() {
-  if (_tun_fd != -1) {
-    close(_tun_fd);
+Gw::~Gw() = default;
+
+void Gw::flush() {
+  if (_udp) {
+    _udp->flush();
+  }
+  if (_shm) {
+    _shm->flush();
+  }
+  for (auto& queue : _tun_queues) {
+    queue->flush();
   }
 }
 
 void Gw::init() {
-  char* err_str = nullptr;
-  struct ifreq ifr = {};
+  _cfg.lookupValue("modem.gw.verify_ip_checksum", _verify_ip_checksum);
+  _cfg.lookupValue("modem.gw.fix_udp_checksum", _fix_udp_checksum);
 
-  _tun_fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
-  spdlog::info("TUN file descriptor {}", _tun_fd);
-  if (0 > _tun_fd) {
-    err_str = strerror(errno);
-    spdlog::error("Failed to open TUN device {}", err_str);
-    _tun_fd = -1;
+  bool pcap = false;
+  _cfg.lookupValue("modem.gw.pcap.enabled", pcap);
+  if (pcap) {
+    _pcap = std::make_unique<PcapTap>(_cfg, _phy, _rest);
+    if (!_pcap->init()) {
+      _pcap.reset();
+    }
+  }
+
+  if (_packet_callback) {
+    _tmgis.resize(MAX_MCH * SRSRAN_N_MCH_LCIDS);
+  }
+
+  std::string egress = "tun";
+  _cfg.lookupValue("modem.gw.egress", egress);
+  if (egress == "none") {
+    spdlog::info("No packet egress, packets are only passed to the packet callback");
+    _egress_none = true;
+    return;
+  }
+  if (egress == "udp") {
+    _udp = std::make_unique<UdpEgress>(_cfg, _phy, _rest);
+    if (!_udp->init()) {
+      _udp.reset();
+    }
+    return;
+  }
+  if (egress == "shm") {
+    _shm = std::make_unique<ShmEgress>(_cfg, _rest);
+    if (!_shm->init()) {
+      _shm.reset();
+    }
+    return;
   }
 
   std::string dev_name = "mbms_modem_tun";
@@ -113,21 +196,86 @@ void Gw::init() {
     dev_name = std::getenv("MODEM_TUN_INTERFACE");
   }
 
+  unsigned queues = 1;
+  _cfg.lookupValue("modem.gw.tun_queues", queues);
+  queues = std::min(std::max(queues, 1U), MAX_MCH);
+
+  bool gso = false;
+  _cfg.lookupValue("modem.gw.tun_gso", gso);
+
+  // The IFF_MULTI_QUEUE flag has to match the one the persistent interface was created with,
+  // otherwise TUNSETIFF fails with EINVAL
+  bool multi_queue = queues > 1;
+  int fd = open_queue(dev_name, multi_queue, gso);
+  if (fd < 0 && errno == EINVAL) {
+    multi_queue = !multi_queue;
+    fd = open_queue(dev_name, multi_queue, gso);
+    if (fd >= 0 && !multi_queue) {
+      spdlog::warn("Cannot open {} with multiple queues, falling back to a single queue. "
+          "Create it with 'ip tuntap add mode tun multi_queue {}' to enable them.", dev_name, dev_name);
+      queues = 1;
+    }
+  }
+  if (fd >= 0 && gso && !TunQueue::enable_gso(fd)) {
+    spdlog::warn("TUN interface does not support UDP segmentation offload (needs Linux 6.2), "
+        "writing packets one by one");
+    close(fd);
+    gso = false;
+    fd = open_queue(dev_name, multi_queue, false);
+  }
+  if (fd < 0) {
+    return;
+  }
+  // With multiple queues, each one writes from its own thread, the delivery thread only hands packets over
+  _tun_queues.emplace_back(new TunQueue(fd, gso, _rest._tun_queues[0], queues > 1));
+
+  if (0 > ioctl(fd, TUNSETPERSIST, 1)) {
+    spdlog::warn("Failed to set TUNSETPERSIST\n");
+  }
+
+  while (_tun_queues.size() < queues) {
+    fd = open_queue(dev_name, true, gso);
+    if (fd < 0) {
+      break;
+    }
+    _tun_queues.emplace_back(new TunQueue(fd, gso, _rest._tun_queues[_tun_queues.size()], true));
+  }
+  _rest._tun_queue_count = queue_count();
+  spdlog::info("TUN interface {} with {} queue(s), UDP segmentation offload {}", dev_name, _tun_queues.size(),
+      gso ? "on" : "off");
+}
+
+auto Gw::open_queue(const std::string& dev_name, bool multi_queue, bool vnet_hdr) -> int {
+  char* err_str = nullptr;
+  struct ifreq ifr = {};
+
+  int fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+  spdlog::info("TUN file descriptor {}", fd);
+  if (0 > fd) {
+    err_str = strerror(errno);
+    spdlog::error("Failed to open TUN device {}", err_str);
+    return -1;
+  }
+
   memset(&ifr, 0, sizeof(ifr));
   ifr.ifr_flags = IFF_UP | IFF_TUN | IFF_NO_PI;
+  if (multi_queue) {
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+  }
+  if (vnet_hdr) {
+    ifr.ifr_flags |= IFF_VNET_HDR;
+  }
   strncpy(ifr.ifr_ifrn.ifrn_name, dev_name.c_str(),
           std::min(dev_name.length(), static_cast<size_t>(IFNAMSIZ - 1)));
   ifr.ifr_ifrn.ifrn_name[IFNAMSIZ - 1] = 0;
 
-  if (0 > ioctl(_tun_fd, TUNSETIFF, &ifr)) {
-    err_str = strerror(errno);
+  if (0 > ioctl(fd, TUNSETIFF, &ifr)) {
+    int err = errno;
+    err_str = strerror(err);
     spdlog::error("Failed to set TUN device name {}", err_str);
-    close(_tun_fd);
-    _tun_fd = -1;
-  }
-
-  if (0 > ioctl(_tun_fd, TUNSETPERSIST, 1)) {
-    err_str = strerror(errno);
-    spdlog::warn("Failed to set TUNSETPERSIST\n");
+    close(fd);
+    errno = err;  // Checked by the caller
+    return -1;
   }
+  return fd;
 }
@@ -23,15 +23,36 @@
 #include "srsran/asn1/rrc.h"
 #include "srsran/interfaces/ue_gw_interfaces.h"
 
+#include <chrono>
+#include <memory>
 #include <string>
+#include <vector>
 #include <libconfig.h++>
 
+#include "Checksum.h"
+#include "Modem.h"
+#include "PcapTap.h"
 #include "Phy.h"
+#include "RestHandler.h"
+#include "ShmEgress.h"
+#include "TunQueue.h"
+#include "UdpEgress.h"
 
 /**
  *  Network gateway component.
  *
  *  Creates a TUN network interface, and writes the received MCH PDU contents out on it.
+ *
+ *  The interface is opened with multiple queues, each with its own file descriptor. The packets
+ *  of an MCH always go to the same queue, so MCHs never share a descriptor with each other
+ *  (up to the number of queues). Each queue writes from its own thread, so the MCHs are written
+ *  concurrently without a lock, and the kernel can process the queues on different CPUs. Packets are
+ *  collected per delivery cycle (one transport block) and written on flush(), optionally coalesced with
+ *  UDP segmentation offload, see TunQueue. A single queue is written directly from the delivery thread.
+ *
+ *  Alternatively, the UDP payloads can be sent directly from a socket (egress = "udp"), see UdpEgress,
+ *  or the packets can be published in a shared memory ring for local readers (egress = "shm"), see ShmEgress.
+ *  With egress = "none", the packets are only passed to the packet callback of the Modem API.
  */
 class Gw : public srsue::gw_interface_stack {
   public:
@@ -40,10 +61,12 @@ class Gw : public srsue::gw_interface_stack {
      *
      *  @param cfg Config singleton reference
      *  @param phy PHY reference
+     *  @param rest RESTful API handler reference
      */
-    Gw(const libconfig::Config& cfg, Phy& phy)
+    Gw(const libconfig::Config& cfg, Phy& phy, RestHandler& rest)
       : _cfg(cfg)
         , _phy(phy)
+        , _rest(rest)
       {}
 
     /**
@@ -52,13 +75,52 @@ class Gw : public srsue::gw_interface_stack {
     virtual ~Gw();
 
     /**
-     *  Creates the TUN interface according to params from Cfg
+     *  Creates the TUN interface, the UDP egress socket or the shared memory ring according to params from Cfg
      */
     void init();
 
     /**
-     *  Handle a MCH PDU. Verifies the contents start with an IP header, checks the IP header checksum
-     *  and corrects it if necessary, and writes the packet out to the TUN interface. 
+     *  Set the callback that receives every IP packet, in addition to the egress. Must be called before init().
+     */
+    void set_packet_callback(Modem::packet_callback_t callback) { _packet_callback = std::move(callback); }
+
+    /**
+     *  Start a delivery cycle. Called before the packets of a transport block are passed in.
+     *
+     *  @param tti TTI of the transport block
+     *  @param received Reception time of its subframe
+     */
+    void begin_tb(uint32_t tti, std::chrono::system_clock::time_point received) { _tti = tti; _tti_received = received; }
+
+    /**
+     *  Send the packets collected in the current delivery cycle. Called after each transport block.
+     */
+    void flush();
+
+    /**
+     *  Number of open TUN queues
+     */
+    unsigned queue_count() const { return static_cast<unsigned>(_tun_queues.size()); }
+
+    /**
+     *  true if packets are sent from the UDP egress socket instead of the TUN interface
+     */
+    bool udp_egress() const { return _udp != nullptr; }
+
+    /**
+     *  true if packets are published in the shared memory ring instead of the TUN interface
+     */
+    bool shm_egress() const { return _shm != nullptr; }
+
+    /**
+     *  true if packets are captured to pcapng files
+     */
+    bool pcap_enabled() const { return _pcap != nullptr; }
+
+    /**
+     *  Handle a MCH PDU. Verifies the contents start with an IPv4 header, checks the IP header checksum
+     *  (and optionally the UDP checksum) and corrects it if necessary, passes the packet to the packet callback,
+     *  and queues it for the egress.
      */
     void write_pdu_mch(uint32_t mch_idx, uint32_t lcid, srsran::unique_byte_buffer_t pdu) override;
 
@@ -72,9 +134,24 @@ class Gw : public srsue::gw_interface_stack {
     int deactivate_eps_bearer(const uint32_t eps_bearer_id) override {return 0;};
     bool is_running() override { return true; };
   private:
+    int open_queue(const std::string& dev_name, bool multi_queue, bool vnet_hdr);
+    void fix_udp_checksum(const iphdr* ip_hdr, udphdr* udp_hdr, uint32_t max_len);
+    const std::string& tmgi(uint32_t mch_idx, uint32_t lcid);
+
     const libconfig::Config& _cfg;
+    bool _verify_ip_checksum = true;
+    bool _fix_udp_checksum = false;
 
-    std::mutex _wr_mutex;
-    int32_t _tun_fd = -1;
+    std::vector<std::unique_ptr<TunQueue>> _tun_queues;
+    std::unique_ptr<UdpEgress> _udp;
+    std::unique_ptr<ShmEgress> _shm;
+    std::unique_ptr<PcapTap> _pcap;
+    bool _egress_none = false;
+    Modem::packet_callback_t _packet_callback;
+    std::vector<std::string> _tmgis;   /**< TMGI per MCH / LCID, resolved on their first packets */
+    uint64_t _tmgi_generation = 0;     /**< Phy::Config::mch_generation _tmgis were resolved with */
+    uint32_t _tti = 0;
+    std::chrono::system_clock::time_point _tti_received = {};
     Phy& _phy;
+    RestHandler& _rest;
 };
@@ -18,31 +18,14 @@
 //
 
 #include "MbsfnFrameProcessor.h"
-#include "spdlog/spdlog.h"
 
-std::map<uint8_t, uint16_t> MbsfnFrameProcessor::_sched_stops;
+#include <cerrno>
+#include <chrono>
+#include <ctime>
 
-std::mutex MbsfnFrameProcessor::_sched_stop_mutex;
-std::mutex MbsfnFrameProcessor::_rlc_mutex;
+#include "spdlog/spdlog.h"
 
 auto MbsfnFrameProcessor::init() -> bool {
-  _signal_buffer_max_samples = 3 * SRSRAN_SF_LEN_PRB(MAX_PRB);
-
-  for (auto ch = 0; ch < _rx_channels; ch++) {
-    _signal_buffer_rx[ch] = srsran_vec_cf_malloc(_signal_buffer_max_samples);
-    if (!_signal_buffer_rx[ch]) {
-      spdlog::error("Could not allocate regular DL signal buffer\n");
-      return false;
-    }
-  }
-
-  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, MAX_PRB, _rx_channels) != 0) {
-    spdlog::error("Could not init ue_dl\n");
-    return false;;
-  }
-
-  srsran_softbuffer_rx_init(&_softbuffer, 100);
-
   _ue_dl_cfg.snr_to_cqi_offset = 0;
 
   srsran_chest_dl_cfg_t* chest_cfg = &_ue_dl_cfg.chest_cfg;
@@ -67,31 +50,222 @@ auto MbsfnFrameProcessor::init() -> bool {
   _pmch_cfg.pdsch_cfg.decoder_type       = SRSRAN_MIMO_DECODER_MMSE;
 
   _sf_cfg.sf_type = SRSRAN_SF_MBSFN;
-  return true;
+
+  // Start out with buffers for the narrowest carrier. They are resized once the cell is known.
+  return set_nof_prb(MIN_PRB);
 }
 
 MbsfnFrameProcessor::~MbsfnFrameProcessor() {
-  srsran_softbuffer_rx_free(&_softbuffer);
-  srsran_ue_dl_free(&_ue_dl);
+  free_buffers();
+}
+
+MbsfnFrameProcessor::IdleList::IdleList(size_t capacity)
+  : _queue(capacity) {
+  sem_init(&_pushed, 0, 0);
+}
+
+MbsfnFrameProcessor::IdleList::~IdleList() {
+  sem_destroy(&_pushed);
+}
+
+auto MbsfnFrameProcessor::IdleList::try_push(MbsfnFrameProcessor* processor) -> bool {
+  if (!_queue.try_push(processor)) {
+    return false;
+  }
+  sem_post(&_pushed);
+  return true;
+}
+
+auto MbsfnFrameProcessor::IdleList::wait_pop(MbsfnFrameProcessor*& processor, std::chrono::milliseconds timeout) -> bool {
+  struct timespec deadline = {};
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  auto ns = deadline.tv_nsec + std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+  deadline.tv_sec += ns / 1000000000;
+  deadline.tv_nsec = ns % 1000000000;
+
+  // try_pop() does not take a post, so the semaphore can be ahead of the list. Stale posts
+  // only cause another try_pop().
+  while (!_queue.try_pop(processor)) {
+    if (sem_timedwait(&_pushed, &deadline) != 0 && errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto MbsfnFrameProcessor::set_nof_prb(uint32_t nof_prb) -> bool {
+  if (nof_prb == _nof_prb) {
+    return true;
+  }
+  auto start = std::chrono::steady_clock::now();
+  free_buffers();
+
+  _signal_buffer_max_samples = 3 * SRSRAN_SF_LEN_PRB(nof_prb);
+  for (unsigned ch = 0; ch < _rx_channels; ch++) {
+    _signal_buffer_rx[ch] = srsran_vec_cf_malloc(_signal_buffer_max_samples);
+    if (!_signal_buffer_rx[ch]) {
+      spdlog::error("Could not allocate regular DL signal buffer\n");
+      free_buffers();
+      return false;
+    }
+  }
+
+  // srsran_ue_dl_init cleans up after itself if it fails
+  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, nof_prb, _rx_channels) != 0) {
+    spdlog::error("Could not init ue_dl\n");
+    free_buffers();
+    return false;
+  }
+  _ue_dl_initialized = true;
+
+  // srsran_softbuffer_rx_free releases a partially initialized softbuffer as well
+  _softbuffer_initialized = true;
+  if (srsran_softbuffer_rx_init(&_softbuffer, nof_prb) != 0) {
+    spdlog::error("Could not init softbuffer\n");
+    free_buffers();
+    return false;
+  }
+
+  // MCCH and MTCH share the PMCH decoder, its implementation is taken from the MTCH settings.
+  // PMCH only produces 16 bit LLRs.
+  if (!_mtch_decoder.apply(&_ue_dl.pmch.dl_sch, false)) {
+    spdlog::error("Could not init PMCH turbo decoder");
+    free_buffers();
+    return false;
+  }
+
+  _nof_prb = nof_prb;
+  // ue_dl has been reset, the cell and MBSFN area have to be set again
+  _mbsfn_configured = false;
+  spdlog::debug("MBSFN processor {}: buffers for {} PRB, {} kB, set up in {} ms", _id, nof_prb, memory_footprint() / 1024,
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+  return true;
+}
+
+void MbsfnFrameProcessor::free_buffers() {
+  // Each step is undone separately, set_nof_prb calls this to unwind a partial allocation
+  if (_softbuffer_initialized) {
+    srsran_softbuffer_rx_free(&_softbuffer);
+    _softbuffer_initialized = false;
+  }
+  if (_ue_dl_initialized) {
+    // The shared sequences are owned by the cache, do not let srsRAN free them
+    for (auto area_id : _shared_areas) {
+      _ue_dl.pmch.seqs[area_id] = nullptr;
+    }
+    _shared_areas.clear();
+    srsran_ue_dl_free(&_ue_dl);
+    _ue_dl_initialized = false;
+  }
+  for (auto& buffer : _signal_buffer_rx) {
+    free(buffer);
+    buffer = nullptr;
+  }
+  _signal_buffer_max_samples = 0;
+  _nof_prb = 0;
 }
 
-void MbsfnFrameProcessor::set_cell(srsran_cell_t cell) {
+auto MbsfnFrameProcessor::memory_footprint() const -> size_t {
+  return static_cast<size_t>(_rx_channels) * _signal_buffer_max_samples * sizeof(cf_t) +
+    static_cast<size_t>(_softbuffer.max_cb) * SOFTBUFFER_SIZE * sizeof(int16_t);
+}
+
+auto MbsfnFrameProcessor::set_cell(srsran_cell_t cell) -> bool {
+  if (cell.nof_prb > _nof_prb) {
+    spdlog::warn("MBSFN processor {} has buffers for {} PRB, resizing for {} PRB", _id, _nof_prb, cell.nof_prb);
+    if (!set_nof_prb(cell.nof_prb)) {
+      spdlog::error("Could not resize MBSFN processor {} for {} PRB", _id, cell.nof_prb);
+      return false;
+    }
+  }
+  if (!_ue_dl_initialized) {
+    return false;
+  }
   _cell = cell;
-  srsran_ue_dl_set_cell(&_ue_dl, cell);
+  if (srsran_ue_dl_set_cell(&_ue_dl, cell) != SRSRAN_SUCCESS) {
+    spdlog::error("Could not set cell on MBSFN processor {}", _id);
+    return false;
+  }
+  return true;
 }
 
 auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
+  if (!estimate(tti)) {
+    return -1;
+  }
+  return decode(tti);
+}
+
+auto MbsfnFrameProcessor::estimate(uint32_t tti) -> bool {
+  auto start = std::chrono::steady_clock::now();
+  auto ret = run_estimate(tti);
+  _fft_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+
+  if (ret < 0) {
+    finish(ret);
+    return false;
+  }
+  return true;
+}
+
+auto MbsfnFrameProcessor::decode(uint32_t tti) -> int {
+  auto start = std::chrono::steady_clock::now();
+  auto ret = run_decode(tti, _slot);
+  auto pmch_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+
+  // Only subframes that went through both stages count towards the decode time. Subframes without
+  // MCCH / MTCH return early and would pull the average, and the processor scaling, down.
+  _rest._mbsfn_dispatch.fft_us += _fft_us;
+  _rest._mbsfn_dispatch.pmch_us += pmch_us;
+  _rest._mbsfn_dispatch.decode_us += _fft_us + pmch_us;
+  _rest._mbsfn_dispatch.decoded++;
+
+  finish(ret);
+  return ret;
+}
+
+void MbsfnFrameProcessor::finish(int ret) {
+  // Return to the idle list first, so the processor can take the next subframe while
+  // the reorder buffer delivers.
+  auto slot = _slot;
+  _slot = nullptr;
+  release();
+  _reorder.complete(slot, ret >= 0);
+}
+
+void MbsfnFrameProcessor::skip(uint32_t tti) {
+  unsigned mch_idx = 0;
+  if (_phy.mbsfn_config_for_tti(tti, mch_idx).is_mcch) {
+    _rest._late_drops.mcch++;
+  } else {
+    _rest._late_drops.mtch++;
+  }
+  spdlog::debug("MBSFN subframe {} is late, skipping", tti);
+
+  auto slot = _slot;
+  _slot = nullptr;
+  release();
+  _reorder.complete(slot, false);
+}
+
+auto MbsfnFrameProcessor::run_estimate(uint32_t tti) -> int {
   spdlog::trace("Processing MBSFN TTI {}", tti);
 
   uint32_t sfn = tti / 10;
-  uint8_t sf = tti % 10;
 
-  unsigned mch_idx = 0;
+  // Kept for the decode stage
+  auto& mch_idx = _mch_idx;
+  auto& mbsfn_cfg = _mbsfn_cfg;
+  mch_idx = 0;
   _sf_cfg.tti = tti;
   _pmch_cfg.area_id = _area_id;
-  srsran_mbsfn_cfg_t mbsfn_cfg = _phy.mbsfn_config_for_tti(tti, mch_idx);
+  mbsfn_cfg = _phy.mbsfn_config_for_tti(tti, mch_idx);
   _ue_dl_cfg.chest_cfg.mbsfn_area_id = _area_id;
-  srsran_ue_dl_set_mbsfn_area_id(&_ue_dl, mbsfn_cfg.mbsfn_area_id);
+  if (!set_area_id(mbsfn_cfg.mbsfn_area_id)) {
+    return -1;
+  }
 
   if (!_cell.mbms_dedicated) {
     srsran_ue_dl_set_non_mbsfn_region(&_ue_dl, mbsfn_cfg.non_mbsfn_region_length);
@@ -109,7 +283,6 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
 
   if (!mbsfn_cfg.enable) {
     spdlog::trace("PMCH: tti {}: neither MCCH nor MCH enabled. Skipping subframe");
-    _mutex.unlock();
     return -1;
   }
 
@@ -126,9 +299,14 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
       _rest._mch[mch_idx].errors++;
     }
     spdlog::error("Getting PDCCH FFT estimate");
-    _mutex.unlock();
     return -1;
   }
+  return 0;
+}
+
+auto MbsfnFrameProcessor::run_decode(uint32_t tti, MchReorderBuffer::Slot* slot) -> int {
+  auto mch_idx = _mch_idx;
+  auto& mbsfn_cfg = _mbsfn_cfg;
 
   srsran_configure_pmch(&_pmch_cfg, &_cell, &mbsfn_cfg);
   srsran_ra_dl_compute_nof_re(&_cell, &_sf_cfg, &_pmch_cfg.pdsch_cfg.grant);
@@ -137,19 +315,28 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
 
   srsran_softbuffer_rx_reset_cb(&_softbuffer, 1);
 
+  auto iterations = (mbsfn_cfg.is_mcch ? _mcch_decoder : _mtch_decoder).iterations(_ue_dl.chest_res.snr_db);
+  _pmch_cfg.pdsch_cfg.max_nof_iterations = iterations;
+  (mbsfn_cfg.is_mcch ? _rest._mcch : _rest._mch[mch_idx]).iteration_cap = iterations;
+
   srsran_pdsch_res_t pmch_dec = {};
   _pmch_cfg.pdsch_cfg.softbuffers.rx[0] = &_softbuffer;
-  pmch_dec.payload = _payload_buffer;
+  pmch_dec.payload = slot->payload;
   srsran_softbuffer_rx_reset_tbs(_pmch_cfg.pdsch_cfg.softbuffers.rx[0], _pmch_cfg.pdsch_cfg.grant.tb[0].tbs);
 
-  if (srsran_ue_dl_decode_pmch(&_ue_dl, &_sf_cfg, &_pmch_cfg, &pmch_dec) != 0) {
+  auto tb_start = std::chrono::steady_clock::now();
+  int pmch_ret = srsran_ue_dl_decode_pmch(&_ue_dl, &_sf_cfg, &_pmch_cfg, &pmch_dec);
+  auto tb_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - tb_start).count());
+  (mbsfn_cfg.is_mcch ? _rest._mcch : _rest._mch[mch_idx]).add_decode_time(tb_us);
+
+  if (pmch_ret != 0) {
     if (mbsfn_cfg.is_mcch) {
       _rest._mcch.errors++;
     } else {
       _rest._mch[mch_idx].errors++;
     }
     spdlog::warn("Error decoding PMCH");
-    _mutex.unlock();
     return -1;
   }
 
@@ -171,43 +358,7 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
     _rest._mch[mch_idx].present = true;
   }
 
-  if (pmch_dec.crc) {
-    mch_mac_msg.init_rx(
-        static_cast<uint32_t>(_pmch_cfg.pdsch_cfg.grant.tb[0].tbs) / 8);
-    mch_mac_msg.parse_packet(_payload_buffer);
-
-    while (mch_mac_msg.next()) {
-      if (srsran::mch_lcid::MCH_SCHED_INFO == mch_mac_msg.get()->mch_ce_type()) {
-        uint16_t stop = 0;
-        uint8_t lcid = 0;
-        while (mch_mac_msg.get()->get_next_mch_sched_info(&lcid, &stop)) {
-          const std::lock_guard<std::mutex> lock(_sched_stop_mutex);
-          spdlog::debug("Scheduling stop for LCID {} in sf {}", lcid, stop);
-          _sched_stops[ lcid ] = stop;
-        }
-      } else if (mch_mac_msg.get()->is_sdu()) {
-        uint32_t lcid = mch_mac_msg.get()->get_sdu_lcid();
-        spdlog::trace("Processing MAC MCH PDU entered, lcid {}", lcid);
-
-        if (lcid >= SRSRAN_N_MCH_LCIDS) {
-          spdlog::warn("Radio bearer id must be in [0:%d] - %d", SRSRAN_N_MCH_LCIDS, lcid);
-          if (mbsfn_cfg.is_mcch) {
-            _rest._mcch.errors++;
-          } else {
-            _rest._mch[mch_idx].errors++;
-          }
-          _mutex.unlock();
-          return -1;
-        }
-
-        {
-          const std::lock_guard<std::mutex> lock(_rlc_mutex);
-          _phy._mcs = mbsfn_cfg.mbsfn_mcs;
-          _rlc.write_pdu_mch(mch_idx, lcid, mch_mac_msg.get()->get_sdu_ptr(), mch_mac_msg.get()->get_payload_size());
-        }
-      }
-    }
-  } else {
+  if (!pmch_dec.crc) {
     if (mbsfn_cfg.is_mcch) {
       _rest._mcch.errors++;
     } else {
@@ -215,38 +366,14 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
     }
 
     spdlog::warn("PMCH in TTI {} failed with CRC error", tti);
-    _mutex.unlock();
     return -1;
   }
 
-  if (!mbsfn_cfg.is_mcch) {
-    for (uint32_t i = 0; i < _phy.mcch().nof_pmch_info; i++) {
-      unsigned fn_in_scheduling_period =  sfn % srsran::enum_to_number(_phy.mcch().pmch_info_list[i].mch_sched_period);
-      unsigned sf_idx;
-      if (_cell.mbms_dedicated) {
-        sf_idx = fn_in_scheduling_period * 10 + sf - (fn_in_scheduling_period / 4) - 1;
-      } else {
-        sf_idx = fn_in_scheduling_period * 6 + (sf < 6 ? sf - 1 : sf - 3);
-      }
-          spdlog::debug("tti{}, sfn {}, sf {}, fn_in_scheduling_period {}, sf_idf {}", tti, sfn, sf, fn_in_scheduling_period, sf_idx);
-
-      const std::lock_guard<std::mutex> lock(_sched_stop_mutex);
-      for (auto itr = _sched_stops.cbegin() ; itr != _sched_stops.cend() ;) {
-        if ( sf_idx >= itr->second ) {
-          const std::lock_guard<std::mutex> lock(_rlc_mutex);
-          spdlog::debug("Stopping LCID {} in tti {} (idx in rf {})", itr->first, tti, sf_idx);
-          _rlc.stop_mch(i, itr->first);
-          itr = _sched_stops.erase(itr);
-        } else {
-          itr = std::next(itr);
-        }
-      }
-    }
-  } else {
-    _rlc.stop_mch(0, 0);
-    _rest._mcch.present = true;
-  }
-  _mutex.unlock();
+  // Hand the transport block to the reorder buffer for in-order delivery to MAC/RLC
+  slot->mch_idx = mch_idx;
+  slot->is_mcch = mbsfn_cfg.is_mcch;
+  slot->mcs = mbsfn_cfg.mbsfn_mcs;
+  slot->tbs_bytes = static_cast<uint32_t>(_pmch_cfg.pdsch_cfg.grant.tb[0].tbs) / 8;
   return mbsfn_cfg.is_mcch ? 0 : 1;
 }
 
@@ -255,11 +382,31 @@ void MbsfnFrameProcessor::configure_mbsfn(uint8_t area_id, srsran_scs_t subcarri
   srsran_ue_dl_set_mbsfn_subcarrier_spacing(&_ue_dl, subcarrier_spacing);
 
 
-  srsran_ue_dl_set_mbsfn_area_id(&_ue_dl, area_id);
+  if (!set_area_id(area_id)) {
+    return;
+  }
   _area_id = area_id;
   _mbsfn_configured = true;
 }
 
+auto MbsfnFrameProcessor::set_area_id(uint16_t area_id) -> bool {
+  if (area_id >= SRSRAN_MAX_MBSFN_AREA_IDS) {
+    spdlog::error("MBSFN area ID {} out of range", area_id);
+    return false;
+  }
+  // srsRAN only generates the PMCH scrambling sequences for an area if they are not present yet.
+  // Hand it the shared ones instead.
+  if (_ue_dl.pmch.seqs[area_id] == nullptr) {
+    auto seqs = _sequences.get(area_id, _ue_dl.pmch.max_re);
+    if (seqs != nullptr) {
+      _ue_dl.pmch.seqs[area_id] = seqs;
+      _shared_areas.push_back(area_id);
+    }
+  }
+  srsran_ue_dl_set_mbsfn_area_id(&_ue_dl, area_id);
+  return true;
+}
+
 auto MbsfnFrameProcessor::mch_data() const -> std::vector<uint8_t> const {
   const uint8_t* data = reinterpret_cast<uint8_t*>(_ue_dl.pmch.d);
   return std::move(std::vector<uint8_t>( data, data + _pmch_cfg.pdsch_cfg.grant.nof_re * sizeof(cf_t)));
@@ -19,41 +19,82 @@
 
 #pragma once
 
+#include <semaphore.h>
+
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <thread>
 #include <vector>
 #include <map>
 #include "srsran/srsran.h"
-#include "srsran/rlc/rlc.h"
-#include "srsran/upper/pdcp.h"
-#include "srsran/mac/pdu.h"
 #include <libconfig.h++>
+#include "BoundedQueue.h"
+#include "DecoderConfig.h"
+#include "MchReorderBuffer.h"
 #include "Phy.h"
+#include "PmchSequenceCache.h"
 #include "RestHandler.h"
 
+class WorkerPool;
+
 /**
- *  Frame processor for MBSFN subframes. Handles the complete processing chain for
- *  a CAS subframe: calls FFT and channel estimation, decodes PDSCH and passes received PDUs to RLC.
+ *  Frame processor for MBSFN subframes. Handles the PHY processing chain for
+ *  an MBSFN subframe: calls FFT and channel estimation, decodes PMCH and places the received
+ *  transport block in the MCH reorder buffer.
  */
 class MbsfnFrameProcessor {
   public:
+    /**
+     *  List of processors that are ready to receive a new subframe. Every push wakes up a
+     *  thread blocked in wait_pop().
+     */
+    class IdleList {
+      public:
+        explicit IdleList(size_t capacity);
+        ~IdleList();
+
+        IdleList(const IdleList&) = delete;
+        IdleList& operator=(const IdleList&) = delete;
+
+        bool try_push(MbsfnFrameProcessor* processor);
+        bool try_pop(MbsfnFrameProcessor*& processor) { return _queue.try_pop(processor); }
+
+        /**
+         *  Take an idle processor, blocking for at most timeout until one is pushed. Returns false on timeout.
+         */
+        bool wait_pop(MbsfnFrameProcessor*& processor, std::chrono::milliseconds timeout);
+
+        size_t size() const { return _queue.size(); }
+
+      private:
+        BoundedMpmcQueue<MbsfnFrameProcessor*> _queue;
+        sem_t _pushed = {};
+    };
+    typedef IdleList idle_list_t;
+
     /**
      *  Default constructor.
      *
      *  @param cfg Config singleton reference
      *  @param phy PHY reference
-     *  @param rlc RLC reference
-     *  @param log_h srsLTE log handle for the MCH MAC msg decoder
      *  @param rest RESTful API handler reference
+     *  @param idle Idle list the processor returns itself to after processing
+     *  @param reorder Reorder buffer that receives the decoded transport blocks
+     *  @param id Index of this processor
+     *  @param sequences Shared PMCH scrambling sequences
      */
-    MbsfnFrameProcessor(const libconfig::Config& cfg, srsran::rlc& rlc, Phy& phy, srslog::basic_logger& log_h, RestHandler& rest, unsigned rx_channels )
+    MbsfnFrameProcessor(const libconfig::Config& cfg, Phy& phy, RestHandler& rest, unsigned rx_channels, idle_list_t& idle, MchReorderBuffer& reorder, unsigned id, PmchSequenceCache& sequences )
       : _cfg(cfg)
-      , _rlc(rlc)
       , _phy(phy)
+      , _idle(idle)
+      , _reorder(reorder)
+      , _id(id)
+      , _sequences(sequences)
       , _rest(rest)
-      , mch_mac_msg(20, log_h)
       , _rx_channels(rx_channels)
+      , _mcch_decoder(cfg, "mcch")
+      , _mtch_decoder(cfg, "mtch")
       {}
 
     /**
@@ -71,26 +112,94 @@ class MbsfnFrameProcessor {
      *  Process the sample data in the signal buffer. Data must already be present in the buffer
      *  obtained through the handle returnd by rx_buffer()
      *
+     *  The processor returns itself to the idle list after (failed or successful) processing, and
+     *  completes the reorder slot set through set_reorder_slot().
+     *
+     *  Runs both pipeline stages, estimate() and decode(), on the calling thread.
+     *
      *  @param tti TTI of the subframe the data belongs to
      */
     int process(uint32_t tti);
 
     /**
-     *  Set the parameters for the cell (Nof PRB, etc).
+     *  First pipeline stage: FFT and channel estimation of the subframe in the signal buffer.
+     *
+     *  Returns true if the subframe is ready for decode(). Otherwise, processing has finished and
+     *  the processor has returned itself to the idle list.
+     *
+     *  @param tti TTI of the subframe the data belongs to
+     */
+    bool estimate(uint32_t tti);
+
+    /**
+     *  Second pipeline stage: PMCH decoding. Must only be called after estimate() returned true.
+     *  The processor returns itself to the idle list afterwards.
+     *
+     *  @param tti TTI of the subframe the data belongs to
+     */
+    int decode(uint32_t tti);
+
+    /**
+     *  Set the reorder buffer slot the next call to process() decodes into
+     */
+    void set_reorder_slot(MchReorderBuffer::Slot* slot) { _slot = slot; }
+
+    /**
+     *  Index of this processor
+     */
+    unsigned id() const { return _id; }
+
+    /**
+     *  Set the worker pool the PMCH decode stage is handed to, or nullptr to run both stages on one worker
+     */
+    void set_decode_pool(WorkerPool* pool) { _decode_pool = pool; }
+
+    /**
+     *  Worker pool of the PMCH decode stage, nullptr if not pipelined
+     */
+    WorkerPool* decode_pool() const { return _decode_pool; }
+
+    /**
+     *  Drop the subframe in the signal buffer without processing it, because it is already too late.
+     *  Returns the processor to the idle list and completes the reorder slot as empty.
+     *
+     *  @param tti TTI of the subframe the data belongs to
+     */
+    void skip(uint32_t tti);
+
+    /**
+     *  Set the parameters for the cell (Nof PRB, etc). Returns false if the buffers could not be
+     *  sized for the cell, the processor must not be used then.
      * 
      *  @param cell The cell we're camping on
      */
-    void set_cell(srsran_cell_t cell);
+    bool set_cell(srsran_cell_t cell);
 
     /**
-     *  Get a handle of the signal buffer to store samples for processing in, 
-     *  and lock this processor.
+     *  Size the signal buffers, softbuffer and decoder state for the passed number of PRB.
+     *  Only reallocates if the number of PRB has changed, the cell and MBSFN parameters
+     *  have to be set again in this case. Must only be called on an idle processor.
      *
-     *  The processor unlocks itself after (failed or successful) frame processing in process().
-     *  If process() is not called by the application after calling this method, it must unlock the 
-     *  processor itself by calling unlock()
+     *  @param nof_prb Number of PRB of the sample rate the signal buffers are filled at
      */
-    cf_t** get_rx_buffer_and_lock() { _mutex.lock(); return _signal_buffer_rx; }
+    bool set_nof_prb(uint32_t nof_prb);
+
+    /**
+     *  Number of PRB the buffers are currently sized for, 0 if they could not be allocated
+     */
+    uint32_t nof_prb() const { return _nof_prb; }
+
+    /**
+     *  Memory held by the signal buffers and softbuffer, in bytes
+     */
+    size_t memory_footprint() const;
+
+    /**
+     *  Get a handle of the signal buffer to store samples for processing in.
+     *
+     *  Must only be called by the owner of a processor taken from the idle list.
+     */
+    cf_t** rx_buffer() { return _signal_buffer_rx; }
 
     /**
      *  Size of the signal buffer
@@ -108,11 +217,10 @@ class MbsfnFrameProcessor {
     bool mbsfn_configured() { return _mbsfn_configured; }
 
     /**
-     *  Unlock the processor
-     *
-     *  @see get_rx_buffer_and_lock() 
+     *  Return the processor to the idle list. Only needed if the application does not
+     *  call process() on a processor it has taken from the idle list.
      */
-    void unlock() { _mutex.unlock(); }
+    void release() { _idle.try_push(this); }
 
     /**
      *  Get the constellation diagram data (I/Q data of the subcarriers after CE)
@@ -125,18 +233,24 @@ class MbsfnFrameProcessor {
     float cinr_db() { return _ue_dl.chest_res.snr_db; }
 
   private:
+    void free_buffers();
+    bool set_area_id(uint16_t area_id);
+    int run_estimate(uint32_t tti);
+    int run_decode(uint32_t tti, MchReorderBuffer::Slot* slot);
+    void finish(int ret);
+
     const libconfig::Config& _cfg;
-    srsran::rlc& _rlc;
     Phy& _phy;
 
     srsran_cell_t _cell;
 
     cf_t*    _signal_buffer_rx[SRSRAN_MAX_PORTS] = {};
     uint32_t _signal_buffer_max_samples          = 0;
+    uint32_t _nof_prb                            = 0;  /**< Number of PRB the buffers are allocated for */
+    bool     _ue_dl_initialized                  = false;
+    bool     _softbuffer_initialized             = false;
 
-    static const uint32_t  _payload_buffer_sz = SRSRAN_MAX_BUFFER_SIZE_BYTES;
-    uint8_t                _payload_buffer[_payload_buffer_sz];
-    srsran_softbuffer_rx_t _softbuffer;
+    srsran_softbuffer_rx_t _softbuffer = {};
 
     srsran_ue_dl_t     _ue_dl     = {};
     srsran_ue_dl_cfg_t _ue_dl_cfg = {};
@@ -146,16 +260,24 @@ class MbsfnFrameProcessor {
     uint8_t _area_id = 1;
     bool _mbsfn_configured = false;
 
-    srsran::mch_pdu mch_mac_msg;
-    std::mutex _mutex;
+    idle_list_t& _idle;
+    MchReorderBuffer& _reorder;
+    MchReorderBuffer::Slot* _slot = nullptr;
+    unsigned _id;
+    WorkerPool* _decode_pool = nullptr;
+
+    PmchSequenceCache& _sequences;
+    std::vector<uint16_t> _shared_areas;  /**< Areas whose sequences in _ue_dl.pmch belong to the cache */
+
+    // State handed from the estimate to the decode stage
+    unsigned _mch_idx = 0;
+    srsran_mbsfn_cfg_t _mbsfn_cfg = {};
+    uint64_t _fft_us = 0;
 
     RestHandler& _rest;
 
     unsigned _rx_channels;
 
-    static std::mutex _sched_stop_mutex;
-    static std::map<uint8_t, uint16_t> _sched_stops;
-
-    static std::mutex _rlc_mutex;
-    static int _current_mcs;
+    DecoderConfig _mcch_decoder;
+    DecoderConfig _mtch_decoder;
 };
@@ -0,0 +1,119 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "MchDemux.h"
+
+#include <algorithm>
+#include <array>
+
+#include "spdlog/spdlog.h"
+
+void MchDemux::deliver(const MchReorderBuffer::Slot& slot) {
+  uint32_t tti = slot.tti;
+  unsigned mch_idx = slot.mch_idx;
+  MchState& mch = _mch[mch_idx];
+
+  _phy._mcs = slot.mcs;
+
+  mch_mac_msg.init_rx(slot.tbs_bytes);
+  mch_mac_msg.parse_packet(slot.payload);
+
+  while (mch_mac_msg.next()) {
+    if (srsran::mch_lcid::MCH_SCHED_INFO == mch_mac_msg.get()->mch_ce_type()) {
+      uint16_t stop = 0;
+      uint8_t lcid = 0;
+      while (mch_mac_msg.get()->get_next_mch_sched_info(&lcid, &stop)) {
+        if (lcid >= SRSRAN_N_MCH_LCIDS) {
+          continue;
+        }
+        spdlog::debug("Scheduling stop for MCH {}, LCID {} in sf {}", mch_idx, lcid, stop);
+        mch.stop[lcid].store(stop, std::memory_order_relaxed);
+        mch.pending.fetch_or(1U << lcid, std::memory_order_release);
+      }
+    } else if (mch_mac_msg.get()->is_sdu()) {
+      uint32_t lcid = mch_mac_msg.get()->get_sdu_lcid();
+      spdlog::trace("Processing MAC MCH PDU entered, lcid {}", lcid);
+
+      if (lcid >= SRSRAN_N_MCH_LCIDS) {
+        spdlog::warn("Radio bearer id must be in [0:%d] - %d", SRSRAN_N_MCH_LCIDS, lcid);
+        if (slot.is_mcch) {
+          _rest._mcch.errors++;
+        } else {
+          _rest._mch[mch_idx].errors++;
+        }
+        return;
+      }
+
+      _rlc.write_pdu_mch(mch_idx, lcid, mch_mac_msg.get()->get_sdu_ptr(), mch_mac_msg.get()->get_payload_size());
+    }
+  }
+
+  if (!slot.is_mcch) {
+    check_sched_stops(tti);
+  } else {
+    _rlc.stop_mch(0, 0);
+    _rest._mcch.present = true;
+  }
+}
+
+void MchDemux::check_sched_stops(uint32_t tti) {
+  uint32_t sfn = tti / 10;
+  uint8_t sf = tti % 10;
+
+  // Copy the scheduling periods out of the configuration snapshot, RLC is called without holding it
+  std::array<unsigned, MAX_MCH> sched_period = {};
+  bool mbms_dedicated = false;
+  uint32_t nof_pmch = 0;
+  {
+    auto config = _phy.config();
+    mbms_dedicated = config->cell.mbms_dedicated;
+    nof_pmch = std::min<uint32_t>(config->mcch.nof_pmch_info, MAX_MCH);
+    for (uint32_t i = 0; i < nof_pmch; i++) {
+      sched_period[i] = srsran::enum_to_number(config->mcch.pmch_info_list[i].mch_sched_period);
+    }
+  }
+
+  for (uint32_t i = 0; i < nof_pmch; i++) {
+    auto pending = _mch[i].pending.load(std::memory_order_acquire);
+    if (pending == 0) {
+      continue;
+    }
+
+    unsigned fn_in_scheduling_period =  sfn % sched_period[i];
+    unsigned sf_idx;
+    if (mbms_dedicated) {
+      sf_idx = fn_in_scheduling_period * 10 + sf - (fn_in_scheduling_period / 4) - 1;
+    } else {
+      sf_idx = fn_in_scheduling_period * 6 + (sf < 6 ? sf - 1 : sf - 3);
+    }
+    spdlog::debug("tti{}, sfn {}, sf {}, fn_in_scheduling_period {}, sf_idf {}", tti, sfn, sf, fn_in_scheduling_period, sf_idx);
+
+    // Only visit the LCIDs that have a pending stop
+    while (pending != 0) {
+      auto lcid = static_cast<uint32_t>(__builtin_ctz(pending));
+      pending &= pending - 1;
+
+      if (sf_idx >= _mch[i].stop[lcid].load(std::memory_order_relaxed)) {
+        spdlog::debug("Stopping MCH {}, LCID {} in tti {} (idx in rf {})", i, lcid, tti, sf_idx);
+        _rlc.stop_mch(i, lcid);
+        _mch[i].pending.fetch_and(~(1U << lcid), std::memory_order_relaxed);
+      }
+    }
+  }
+}
@@ -0,0 +1,90 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "srsran/srsran.h"
+#include "srsran/rlc/rlc.h"
+#include "srsran/mac/pdu.h"
+#include <libconfig.h++>
+#include "MchReorderBuffer.h"
+#include "Phy.h"
+#include "RestHandler.h"
+
+/**
+ *  MCH MAC demultiplexer. Parses decoded MCH transport blocks, passes the contained MAC SDUs
+ *  to RLC and handles the MCH scheduling information (stopping of LCIDs at the end of their
+ *  allocation in the scheduling period).
+ *
+ *  Transport blocks must be passed in subframe order, from one thread at a time.
+ *
+ *  Scheduling state is kept per MCH in fixed arrays indexed by LCID, so the per-subframe stop check
+ *  only visits the LCIDs that still have a pending stop.
+ */
+class MchDemux {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param phy PHY reference
+     *  @param rlc RLC reference
+     *  @param log_h srsLTE log handle for the MCH MAC msg decoder
+     *  @param rest RESTful API handler reference
+     */
+    MchDemux(const libconfig::Config& cfg, Phy& phy, srsran::rlc& rlc, srslog::basic_logger& log_h, RestHandler& rest)
+      : _cfg(cfg)
+      , _phy(phy)
+      , _rlc(rlc)
+      , _rest(rest)
+      , mch_mac_msg(20, log_h)
+      {}
+
+    /**
+     *  Default destructor.
+     */
+    virtual ~MchDemux() = default;
+
+    /**
+     *  Handle a decoded transport block
+     */
+    void deliver(const MchReorderBuffer::Slot& slot);
+
+  private:
+    const libconfig::Config& _cfg;
+    Phy& _phy;
+    srsran::rlc& _rlc;
+    RestHandler& _rest;
+
+    void check_sched_stops(uint32_t tti);
+
+    /**
+     *  Scheduling state of one MCH
+     */
+    struct MchState {
+      std::array<std::atomic<uint16_t>, SRSRAN_N_MCH_LCIDS> stop = {};  /**< Stop subframe index per LCID, from the MSI */
+      std::atomic<uint32_t> pending = {0};                              /**< Bitmask of LCIDs with a pending stop */
+    };
+
+    srsran::mch_pdu mch_mac_msg;
+    std::array<MchState, MAX_MCH> _mch;
+};
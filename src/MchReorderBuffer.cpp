@@ -0,0 +1,181 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "MchReorderBuffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+#include "srsran/srsran.h"
+#include "spdlog/spdlog.h"
+
+MchReorderBuffer::MchReorderBuffer(const libconfig::Config& cfg, RestHandler& rest, deliver_t deliver)
+  : _cfg(cfg)
+  , _rest(rest)
+  , _deliver(std::move(deliver)) {
+  _cfg.lookupValue("modem.phy.reorder.slots", _nof_slots);
+  // Slots are indexed modulo the slot count
+  _nof_slots = std::max(_nof_slots, 1U);
+  unsigned max_wait_ms = 10;
+  _cfg.lookupValue("modem.phy.reorder.max_wait_ms", max_wait_ms);
+  _max_wait = std::chrono::milliseconds(max_wait_ms);
+
+  _payload_size = SRSRAN_MAX_BUFFER_SIZE_BYTES;
+  _payload = std::make_unique<uint8_t[]>(static_cast<size_t>(_nof_slots) * _payload_size);
+  _slots = std::make_unique<Slot[]>(_nof_slots);
+  for (unsigned i = 0; i < _nof_slots; i++) {
+    _slots[i].payload = &_payload[static_cast<size_t>(i) * _payload_size];
+  }
+
+  _delivery_queue = std::make_unique<SpscQueue<Slot*>>(_nof_slots);
+  sem_init(&_delivery_pending, 0, 0);
+  _delivery_thread = std::thread{&MchReorderBuffer::delivery_loop, this};
+
+  spdlog::info("MCH reorder buffer: {} slots, max wait {} ms", _nof_slots, max_wait_ms);
+}
+
+MchReorderBuffer::~MchReorderBuffer() {
+  _stop = true;
+  sem_post(&_delivery_pending);
+  if (_delivery_thread.joinable()) {
+    _delivery_thread.join();
+  }
+  sem_destroy(&_delivery_pending);
+}
+
+auto MchReorderBuffer::reserve(uint32_t tti) -> Slot* {
+  Slot& slot = _slots[_next_seq % _nof_slots];
+  if (slot.state.load(std::memory_order_acquire) != SlotState::Free) {
+    _rest._mch_reorder.overflows++;
+    return nullptr;
+  }
+
+  slot.tti = tti;
+  slot.mch_idx = 0;
+  slot.is_mcch = false;
+  slot.mcs = 0;
+  slot.tbs_bytes = 0;
+  slot.received = std::chrono::system_clock::now();
+  slot.deadline = std::chrono::steady_clock::now() + _max_wait;
+  slot.state.store(SlotState::Pending, std::memory_order_release);
+
+  _next_seq++;
+  _reserved.store(_next_seq, std::memory_order_release);
+  return &slot;
+}
+
+void MchReorderBuffer::complete(Slot* slot, bool ready) {
+  slot->completed = std::chrono::steady_clock::now();
+  auto expected = SlotState::Pending;
+  if (!slot->state.compare_exchange_strong(expected, ready ? SlotState::Ready : SlotState::Empty)) {
+    // The drainer gave up on this slot while it was still being decoded. Nobody will
+    // deliver it anymore, so just make it available again.
+    slot->state.store(SlotState::Free, std::memory_order_release);
+    return;
+  }
+  drain();
+}
+
+void MchReorderBuffer::drain() {
+  // Only one thread delivers at a time. A thread that finds the drainer busy leaves its completed
+  // slot to it - the drainer re-checks the head after releasing the flag, so no slot is left behind.
+  for (;;) {
+    if (_draining.test_and_set()) {
+      return;
+    }
+    drain_locked();
+    _draining.clear();
+
+    if (!head_deliverable()) {
+      return;
+    }
+  }
+}
+
+auto MchReorderBuffer::head_deliverable() -> bool {
+  auto head = _head.load();
+  if (head == _reserved.load()) {
+    return false;
+  }
+  auto state = _slots[head % _nof_slots].state.load();
+  return state == SlotState::Ready || state == SlotState::Empty;
+}
+
+auto MchReorderBuffer::drain_locked() -> bool {
+  bool delivered = false;
+  auto head = _head.load(std::memory_order_relaxed);
+  while (head != _reserved.load(std::memory_order_acquire)) {
+    Slot& slot = _slots[head % _nof_slots];
+    auto state = slot.state.load(std::memory_order_acquire);
+
+    if (state == SlotState::Ready) {
+      slot.queued = std::chrono::steady_clock::now();
+      _rest._mch_reorder.reorder_wait_us += static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(slot.queued - slot.completed).count());
+      slot.state.store(SlotState::Queued, std::memory_order_relaxed);
+      _delivery_queue->try_push(&slot);
+      sem_post(&_delivery_pending);
+      delivered = true;
+    } else if (state == SlotState::Empty) {
+      slot.state.store(SlotState::Free, std::memory_order_release);
+    } else if (state == SlotState::Pending) {
+      if (std::chrono::steady_clock::now() < slot.deadline) {
+        // Wait for this subframe before delivering any later one.
+        break;
+      }
+      auto expected = SlotState::Pending;
+      if (!slot.state.compare_exchange_strong(expected, SlotState::Abandoned)) {
+        // Completed just now, evaluate it again.
+        continue;
+      }
+      spdlog::debug("MCH reorder: TTI {} not decoded in time, skipping", slot.tti);
+      _rest._mch_reorder.skipped++;
+    }
+    _head.store(++head);
+  }
+  return delivered;
+}
+
+void MchReorderBuffer::delivery_loop() {
+  Slot* slot = nullptr;
+  for (;;) {
+    while (sem_wait(&_delivery_pending) != 0 && errno == EINTR) {}
+
+    if (!_delivery_queue->try_pop(slot)) {
+      if (_stop) {
+        break;
+      }
+      continue;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    _deliver(*slot);
+    auto end = std::chrono::steady_clock::now();
+
+    _rest._mch_reorder.queue_wait_us += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(start - slot->queued).count());
+    _rest._mch_reorder.deliver_us += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    _rest._mch_reorder.queue_depth = _delivery_queue->size();
+    _rest._mch_reorder.delivered++;
+
+    slot->state.store(SlotState::Free, std::memory_order_release);
+  }
+}
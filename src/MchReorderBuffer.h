@@ -0,0 +1,145 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <semaphore.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <libconfig.h++>
+
+#include "BoundedQueue.h"
+#include "RestHandler.h"
+
+/**
+ *  Reorder stage between the MBSFN frame processors and RLC.
+ *
+ *  The main loop reserves a slot for every MBSFN subframe it dispatches, in TTI order. The frame
+ *  processor decodes the transport block directly into the slot's payload buffer and marks it complete.
+ *  Completed slots are passed on strictly in dispatch order, by a single drainer at a time. A slot that
+ *  is not completed within the configured wait time is skipped, so one slow subframe cannot stall the stream.
+ *
+ *  The drainer only queues the slots on a single-producer / single-consumer queue. The delivery function
+ *  (MAC, RLC, PDCP and the TUN write) runs on a dedicated delivery thread, so the PHY workers return
+ *  to decoding immediately.
+ */
+class MchReorderBuffer {
+  public:
+    enum class SlotState : uint8_t {
+      Free,       /**< Available for reservation */
+      Pending,    /**< Reserved, being decoded */
+      Ready,      /**< Decoded transport block available */
+      Queued,     /**< Queued for the delivery thread */
+      Empty,      /**< Processed, but nothing to deliver */
+      Abandoned   /**< Skipped by the drainer, still being decoded */
+    };
+
+    /**
+     *  One reserved subframe
+     */
+    struct Slot {
+      std::atomic<SlotState> state = {SlotState::Free};
+      uint32_t tti = 0;
+      unsigned mch_idx = 0;
+      bool is_mcch = false;
+      int mcs = 0;
+      uint32_t tbs_bytes = 0;
+      std::chrono::system_clock::time_point received = {};   /**< Time the subframe was received */
+      std::chrono::steady_clock::time_point deadline = {};
+      std::chrono::steady_clock::time_point completed = {};
+      std::chrono::steady_clock::time_point queued = {};
+      uint8_t* payload = nullptr;
+    };
+
+    /**
+     *  Delivery function, called on the delivery thread for every ready slot in dispatch order
+     */
+    typedef std::function<void(const Slot&)> deliver_t;
+
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param rest RESTful API handler reference
+     *  @param deliver Delivery function for decoded transport blocks
+     */
+    MchReorderBuffer(const libconfig::Config& cfg, RestHandler& rest, deliver_t deliver);
+
+    /**
+     *  Default destructor. Stops the delivery thread.
+     */
+    virtual ~MchReorderBuffer();
+
+    /**
+     *  Reserve the next slot for the subframe with the passed TTI. Must only be called from the main loop.
+     *
+     *  Returns nullptr if the reorder window is full. The subframe must be dropped in this case.
+     */
+    Slot* reserve(uint32_t tti);
+
+    /**
+     *  Mark a reserved slot as processed, and deliver all slots that are now in order.
+     *
+     *  @param slot The slot returned by reserve()
+     *  @param ready true if the slot's payload holds a decoded transport block
+     */
+    void complete(Slot* slot, bool ready);
+
+    /**
+     *  Size of the payload buffer of each slot
+     */
+    uint32_t payload_size() const { return _payload_size; }
+
+    /**
+     *  Number of transport blocks waiting for the delivery thread
+     */
+    size_t delivery_queue_depth() const { return _delivery_queue->size(); }
+
+  private:
+    void drain();
+    bool drain_locked();
+    bool head_deliverable();
+    void delivery_loop();
+
+    const libconfig::Config& _cfg;
+    RestHandler& _rest;
+    deliver_t _deliver;
+
+    unsigned _nof_slots = 32;
+    std::unique_ptr<Slot[]> _slots;
+    uint32_t _payload_size = 0;
+    std::unique_ptr<uint8_t[]> _payload;
+    std::chrono::microseconds _max_wait = std::chrono::milliseconds(10);
+
+    uint64_t _next_seq = 0;                     /**< Next sequence number to reserve (main loop only) */
+    std::atomic<uint64_t> _reserved = {0};      /**< Number of reserved slots, published to the drainer */
+    std::atomic<uint64_t> _head = {0};          /**< Next sequence number to deliver (written by the drainer only) */
+    std::atomic_flag _draining = ATOMIC_FLAG_INIT;
+
+    // Every queued slot is still in use, so the queue can never hold more than _nof_slots entries
+    std::unique_ptr<SpscQueue<Slot*>> _delivery_queue;
+    sem_t _delivery_pending = {};
+    std::atomic<bool> _stop = {false};
+    std::thread _delivery_thread;
+};
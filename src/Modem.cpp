@@ -0,0 +1,61 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "Modem.h"
+
+#include <thread>
+
+#include "ReceiveChain.h"
+#include "SdrReader.h"
+
+Modem::Modem(const libconfig::Config& cfg, const Options& options)
+  : _chain(std::make_unique<ReceiveChain>(cfg, options)) {}
+
+Modem::~Modem() {
+  stop();
+}
+
+void Modem::set_packet_callback(packet_callback_t callback) {
+  _chain->set_packet_callback(std::move(callback));
+}
+
+auto Modem::init() -> bool {
+  return _chain->init();
+}
+
+void Modem::start() {
+  _thread = std::thread{&ReceiveChain::run, _chain.get()};
+}
+
+void Modem::run() {
+  _chain->run();
+}
+
+void Modem::stop() {
+  _chain->stop();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+void Modem::list_sdr_devices(const libconfig::Config& cfg) {
+  SdrReader sdr(cfg, 1);
+  sdr.enumerateDevices();
+}
@@ -0,0 +1,317 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "PcapTap.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include "spdlog/spdlog.h"
+
+// pcapng block types and options
+static const uint32_t kSectionHeaderBlock = 0x0A0D0D0A;
+static const uint32_t kInterfaceDescriptionBlock = 1;
+static const uint32_t kEnhancedPacketBlock = 6;
+static const uint16_t kOptEndOfOpt = 0;
+static const uint16_t kOptComment = 1;
+static const uint16_t kOptShbUserAppl = 4;
+static const uint16_t kOptIfName = 2;
+static const uint16_t kOptIfTsResol = 9;
+static const uint16_t kLinkTypeRaw = 101;      // Raw IP, no link layer header
+
+static void append(std::vector<uint8_t>& buf, const void* data, size_t len) {
+  auto ptr = static_cast<const uint8_t*>(data);
+  buf.insert(buf.end(), ptr, ptr + len);
+  buf.resize((buf.size() + 3) & ~static_cast<size_t>(3), 0);
+}
+
+static void append_u16(std::vector<uint8_t>& buf, uint16_t value) {
+  auto ptr = reinterpret_cast<const uint8_t*>(&value);
+  buf.insert(buf.end(), ptr, ptr + sizeof(value));
+}
+
+static void append_u32(std::vector<uint8_t>& buf, uint32_t value) {
+  auto ptr = reinterpret_cast<const uint8_t*>(&value);
+  buf.insert(buf.end(), ptr, ptr + sizeof(value));
+}
+
+static void append_option(std::vector<uint8_t>& buf, uint16_t code, const void* data, size_t len) {
+  append_u16(buf, code);
+  append_u16(buf, static_cast<uint16_t>(len));
+  append(buf, data, len);
+}
+
+static void append_end_of_options(std::vector<uint8_t>& buf) {
+  append_u16(buf, kOptEndOfOpt);
+  append_u16(buf, 0);
+}
+
+PcapTap::PcapTap(const libconfig::Config& cfg, Phy& phy, RestHandler& rest)
+  : _cfg(cfg)
+  , _phy(phy)
+  , _rest(rest) {
+  _cfg.lookupValue("modem.gw.pcap.file", _file_prefix);
+  if (_file_prefix.size() > 7 && _file_prefix.compare(_file_prefix.size() - 7, 7, ".pcapng") == 0) {
+    _file_prefix.resize(_file_prefix.size() - 7);
+  }
+  unsigned max_size_mb = 100;
+  _cfg.lookupValue("modem.gw.pcap.max_size_mb", max_size_mb);
+  _max_size = static_cast<uint64_t>(max_size_mb) << 20;
+  unsigned max_duration_s = 0;
+  _cfg.lookupValue("modem.gw.pcap.max_duration_s", max_duration_s);
+  _max_duration = std::chrono::seconds(max_duration_s);
+  _cfg.lookupValue("modem.gw.pcap.snaplen", _snaplen);
+  _snaplen = std::max(_snaplen, 64U);
+  unsigned slots = 4096;
+  _cfg.lookupValue("modem.gw.pcap.queue_size", slots);
+  slots = std::max(slots, 16U);
+
+  if (_cfg.exists("modem.gw.pcap.filters")) {
+    const libconfig::Setting& filters = _cfg.lookup("modem.gw.pcap.filters");
+    for (int i = 0; i < filters.getLength(); i++) {
+      Filter filter;
+      filters[i].lookupValue("tmgi", filter.tmgi);
+      filters[i].lookupValue("lcid", filter.lcid);
+      if (filter.tmgi.empty() && filter.lcid < 0) {
+        spdlog::error("Ignoring invalid packet capture filter {}", i);
+        continue;
+      }
+      _filters.push_back(filter);
+    }
+  }
+  _matches.resize(MAX_MCH * SRSRAN_N_MCH_LCIDS, Match::Unknown);
+  _block.reserve(_snaplen + 128);
+
+  _buffers = std::make_unique<uint8_t[]>(static_cast<size_t>(slots) * _snaplen);
+  _captures = std::make_unique<Capture[]>(slots);
+  _free = std::make_unique<SpscQueue<uint32_t>>(slots);
+  _queued = std::make_unique<SpscQueue<uint32_t>>(slots);
+  for (uint32_t i = 0; i < slots; i++) {
+    _captures[i].data = &_buffers[static_cast<size_t>(i) * _snaplen];
+    _free->try_push(i);
+  }
+  sem_init(&_pending, 0, 0);
+}
+
+PcapTap::~PcapTap() {
+  _stop = true;
+  sem_post(&_pending);
+  if (_writer.joinable()) {
+    _writer.join();
+  }
+  close_file();
+  sem_destroy(&_pending);
+}
+
+auto PcapTap::init() -> bool {
+  if (!open_file()) {
+    return false;
+  }
+  _writer = std::thread{&PcapTap::writer_loop, this};
+  spdlog::info("Packet capture to {}-*.pcapng, {} filter(s), snaplen {}", _file_prefix, _filters.size(), _snaplen);
+  return true;
+}
+
+auto PcapTap::match(uint32_t mch_idx, uint32_t lcid) -> Match {
+  if (_filters.empty()) {
+    return Match::Capture;
+  }
+  if (mch_idx >= MAX_MCH || lcid >= SRSRAN_N_MCH_LCIDS) {
+    return Match::Skip;
+  }
+  auto config = _phy.config();
+  if (config->mch_generation != _generation) {
+    // New MCCH, or resync: the TMGIs have to be resolved again
+    std::fill(_matches.begin(), _matches.end(), Match::Unknown);
+    _generation = config->mch_generation;
+  }
+  auto& match = _matches[mch_idx * SRSRAN_N_MCH_LCIDS + lcid];
+  if (match != Match::Unknown) {
+    return match;
+  }
+
+  auto tmgi = config->tmgi(mch_idx, lcid);
+
+  auto result = Match::Skip;
+  for (const auto& filter : _filters) {
+    if (filter.lcid == static_cast<int>(lcid) || (!filter.tmgi.empty() && filter.tmgi == tmgi)) {
+      result = Match::Capture;
+      break;
+    }
+  }
+  // Without a TMGI yet, try again on the next packet
+  if (result == Match::Capture || !tmgi.empty()) {
+    match = result;
+  }
+  return result;
+}
+
+void PcapTap::capture(uint32_t mch_idx, uint32_t lcid, uint32_t tti, std::chrono::system_clock::time_point received,
+    const srsran::byte_buffer_t& pdu) {
+  if (match(mch_idx, lcid) != Match::Capture) {
+    return;
+  }
+  uint32_t idx = 0;
+  if (!_free->try_pop(idx)) {
+    _rest._pcap.dropped++;
+    return;
+  }
+
+  auto& capture = _captures[idx];
+  capture.timestamp_ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(received.time_since_epoch()).count());
+  capture.tti = tti;
+  capture.mch_idx = static_cast<uint16_t>(mch_idx);
+  capture.lcid = static_cast<uint16_t>(lcid);
+  capture.orig_len = pdu.N_bytes;
+  capture.len = std::min(pdu.N_bytes, _snaplen);
+  memcpy(capture.data, pdu.msg, capture.len);
+
+  // Every slot is either free or queued, so this cannot fail
+  _queued->try_push(idx);
+  sem_post(&_pending);
+  _rest._pcap.captured++;
+}
+
+void PcapTap::writer_loop() {
+  auto last_flush = std::chrono::steady_clock::now();
+  uint32_t idx = 0;
+  for (;;) {
+    // Wake up at least once per second to flush and rotate
+    struct timespec timeout = {};
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_sec += 1;
+    while (sem_timedwait(&_pending, &timeout) != 0 && errno == EINTR) {}
+
+    while (_queued->try_pop(idx)) {
+      write(_captures[idx]);
+      _free->try_push(idx);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (_file != nullptr && now - last_flush >= std::chrono::seconds(1)) {
+      fflush(_file);
+      last_flush = now;
+    }
+    if (_stop && _queued->size() == 0) {
+      break;
+    }
+  }
+}
+
+void PcapTap::write(const Capture& capture) {
+  auto now = std::chrono::steady_clock::now();
+  if (_file == nullptr ||
+      (_max_size > 0 && _file_size >= _max_size) ||
+      (_max_duration.count() > 0 && now - _file_opened >= _max_duration)) {
+    close_file();
+    if (!open_file()) {
+      _rest._pcap.errors++;
+      return;
+    }
+  }
+
+  char comment[64];  // NOLINT
+  int comment_len = snprintf(comment, sizeof(comment), "TTI %u, MCH %u, LCID %u",
+      capture.tti, capture.mch_idx, capture.lcid);
+
+  _block.clear();
+  append_u32(_block, 0);   // interface
+  append_u32(_block, static_cast<uint32_t>(capture.timestamp_ns >> 32));
+  append_u32(_block, static_cast<uint32_t>(capture.timestamp_ns));
+  append_u32(_block, capture.len);
+  append_u32(_block, capture.orig_len);
+  append(_block, capture.data, capture.len);
+  append_option(_block, kOptComment, comment, static_cast<size_t>(comment_len));
+  append_end_of_options(_block);
+  write_block(kEnhancedPacketBlock);
+}
+
+auto PcapTap::open_file() -> bool {
+  char date[32];  // NOLINT
+  auto time = std::time(nullptr);
+  struct tm tm = {};
+  localtime_r(&time, &tm);
+  strftime(date, sizeof(date), "%Y%m%d-%H%M%S", &tm);
+  _file_name = _file_prefix + "-" + date + "-" + std::to_string(_file_count) + ".pcapng";
+
+  _file = fopen(_file_name.c_str(), "wb");
+  if (_file == nullptr) {
+    if (!_open_failed) {
+      spdlog::error("Cannot open packet capture file {}: {}", _file_name, strerror(errno));
+    }
+    _open_failed = true;
+    return false;
+  }
+  _open_failed = false;
+  setvbuf(_file, nullptr, _IOFBF, 1 << 20);
+  _file_count++;
+  _file_size = 0;
+  _file_opened = std::chrono::steady_clock::now();
+  _rest._pcap.files++;
+
+  static const char kUserAppl[] = "5G-MAG Reference Tools MBMS Modem";
+  _block.clear();
+  append_u32(_block, 0x1A2B3C4D);   // byte order magic
+  append_u16(_block, 1);            // version 1.0
+  append_u16(_block, 0);
+  append_u32(_block, 0xFFFFFFFF);   // section length not specified
+  append_u32(_block, 0xFFFFFFFF);
+  append_option(_block, kOptShbUserAppl, kUserAppl, sizeof(kUserAppl) - 1);
+  append_end_of_options(_block);
+  write_block(kSectionHeaderBlock);
+
+  static const char kIfName[] = "mbms_modem";
+  uint8_t ts_resol = 9;             // nanoseconds
+  _block.clear();
+  append_u16(_block, kLinkTypeRaw);
+  append_u16(_block, 0);
+  append_u32(_block, _snaplen);
+  append_option(_block, kOptIfName, kIfName, sizeof(kIfName) - 1);
+  append_option(_block, kOptIfTsResol, &ts_resol, sizeof(ts_resol));
+  append_end_of_options(_block);
+  write_block(kInterfaceDescriptionBlock);
+
+  spdlog::info("Packet capture: writing to {}", _file_name);
+  return true;
+}
+
+void PcapTap::close_file() {
+  if (_file != nullptr) {
+    fclose(_file);
+    _file = nullptr;
+  }
+}
+
+void PcapTap::write_block(uint32_t type) {
+  uint32_t total = static_cast<uint32_t>(_block.size()) + 3 * sizeof(uint32_t);
+  bool ok = fwrite(&type, sizeof(type), 1, _file) == 1 &&
+    fwrite(&total, sizeof(total), 1, _file) == 1 &&
+    fwrite(_block.data(), 1, _block.size(), _file) == _block.size() &&
+    fwrite(&total, sizeof(total), 1, _file) == 1;
+  if (!ok) {
+    _rest._pcap.errors++;
+    return;
+  }
+  _file_size += total;
+  _rest._pcap.bytes += total;
+}
@@ -0,0 +1,156 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <semaphore.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libconfig.h++>
+
+#include "srsran/srsran.h"
+#include "srsran/common/byte_buffer.h"
+
+#include "BoundedQueue.h"
+#include "Phy.h"
+#include "RestHandler.h"
+
+/**
+ *  Packet capture of the decoded IP traffic, written to pcapng files.
+ *
+ *  The delivery thread copies each packet that passes the TMGI / LCID filter into a preallocated
+ *  capture slot and queues it for a background writer thread, so capturing never blocks packet delivery
+ *  and never allocates. If all slots are in use because the writer has fallen behind, the packet is
+ *  not captured and counted as dropped.
+ *
+ *  Packets are timestamped with the reception time of their subframe. The TTI, MCH and LCID
+ *  are recorded in the comment of each packet. Files are rotated by size and / or age.
+ */
+class PcapTap {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param phy PHY reference, for the TMGI of an MCH / LCID
+     *  @param rest RESTful API handler reference
+     */
+    PcapTap(const libconfig::Config& cfg, Phy& phy, RestHandler& rest);
+
+    /**
+     *  Default destructor. Writes the queued packets and stops the writer thread.
+     */
+    virtual ~PcapTap();
+
+    PcapTap(const PcapTap&) = delete;
+    PcapTap& operator=(const PcapTap&) = delete;
+
+    /**
+     *  Open the first capture file and start the writer thread. Returns false on failure.
+     */
+    bool init();
+
+    /**
+     *  Capture a packet, if it passes the filter. Must only be called from the delivery thread.
+     *
+     *  @param mch_idx MCH index
+     *  @param lcid Logical channel the packet was received on
+     *  @param tti TTI of the transport block the packet was received in
+     *  @param received Reception time of that subframe
+     *  @param pdu The IP packet
+     */
+    void capture(uint32_t mch_idx, uint32_t lcid, uint32_t tti, std::chrono::system_clock::time_point received,
+        const srsran::byte_buffer_t& pdu);
+
+  private:
+    /**
+     *  Configured filter entry, matches a TMGI or an LCID
+     */
+    struct Filter {
+      std::string tmgi;
+      int lcid = -1;
+    };
+
+    /**
+     *  Filter result of an MCH / LCID
+     */
+    enum class Match : uint8_t {
+      Unknown,
+      Capture,
+      Skip
+    };
+
+    /**
+     *  One captured packet
+     */
+    struct Capture {
+      uint64_t timestamp_ns = 0;
+      uint32_t tti = 0;
+      uint16_t mch_idx = 0;
+      uint16_t lcid = 0;
+      uint32_t orig_len = 0;
+      uint32_t len = 0;
+      uint8_t* data = nullptr;
+    };
+
+    Match match(uint32_t mch_idx, uint32_t lcid);
+    void writer_loop();
+    void write(const Capture& capture);
+    bool open_file();
+    void close_file();
+    void write_block(uint32_t type);
+
+    const libconfig::Config& _cfg;
+    Phy& _phy;
+    RestHandler& _rest;
+
+    std::vector<Filter> _filters;
+    std::vector<Match> _matches;       /**< Per MCH / LCID, resolved on the first packet */
+    uint64_t _generation = 0;          /**< Phy::Config::mch_generation _matches were resolved with */
+
+    std::string _file_prefix = "/var/log/5gmag-rt-modem";
+    uint64_t _max_size = 100ULL << 20;
+    std::chrono::seconds _max_duration = std::chrono::seconds(0);
+    uint32_t _snaplen = 2048;
+
+    std::unique_ptr<uint8_t[]> _buffers;
+    std::unique_ptr<Capture[]> _captures;
+    std::unique_ptr<SpscQueue<uint32_t>> _free;     /**< Writer -> delivery thread */
+    std::unique_ptr<SpscQueue<uint32_t>> _queued;   /**< Delivery thread -> writer */
+    sem_t _pending = {};
+
+    FILE* _file = nullptr;
+    bool _open_failed = false;
+    std::string _file_name;
+    std::vector<uint8_t> _block;       /**< Body of the block being written */
+    unsigned _file_count = 0;
+    uint64_t _file_size = 0;
+    std::chrono::steady_clock::time_point _file_opened = {};
+
+    std::atomic<bool> _stop = {false};
+    std::thread _writer;
+};
@@ -32,7 +32,6 @@ static auto receive_callback(void* obj, cf_t* data[SRSRAN_MAX_CHANNELS],
   return (static_cast<Phy*>(obj))->_sample_cb(data, nsamples, rx_time);       // NOLINT
 }
 
-const uint32_t kMaxBufferSamples = 2 * 15360;
 const uint32_t kMaxSfn = 1024;
 const uint32_t kSfnOffset = 4;
 const uint32_t kSubframesPerFrame = 10;
@@ -46,7 +45,8 @@ Phy::Phy(const libconfig::Config& cfg, get_samples_t cb, uint8_t cs_nof_prb,
       _cs_nof_prb(cs_nof_prb),
       _override_nof_prb(override_nof_prb),
       _rx_channels(rx_channels) {
-  _buffer_max_samples = kMaxBufferSamples;
+  // Follows srsran_use_standard_symbol_size(), which must be set before
+  _buffer_max_samples = 2 * SRSRAN_SF_LEN_PRB(MAX_PRB);
   _mib_buffer[0] = static_cast<cf_t*>(malloc(_buffer_max_samples * sizeof(cf_t)));  // NOLINT
   _mib_buffer[1] = static_cast<cf_t*>(malloc(_buffer_max_samples * sizeof(cf_t)));  // NOLINT
 }
@@ -72,14 +72,16 @@ auto Phy::synchronize_subframe() -> bool {
           srsran_ue_mib_decode(&_mib, bch_payload.data(), nullptr, &sfn_offset);
       if (n == 1) {
         uint32_t sfn = 0;
-        if (_cell.mbms_dedicated) {
-          srsran_pbch_mib_mbms_unpack(bch_payload.data(), &_cell, &sfn, nullptr,
-              _override_nof_prb);
-          sfn = (sfn + sfn_offset * kSfnOffset) % kMaxSfn;
-        } else {
-          srsran_pbch_mib_unpack(bch_payload.data(), &_cell, &sfn);
-          sfn = (sfn + sfn_offset) % kMaxSfn;
-        }
+        _config.update([&](Config& config) {
+          if (config.cell.mbms_dedicated) {
+            srsran_pbch_mib_mbms_unpack(bch_payload.data(), &config.cell, &sfn, nullptr,
+                _override_nof_prb);
+            sfn = (sfn + sfn_offset * kSfnOffset) % kMaxSfn;
+          } else {
+            srsran_pbch_mib_unpack(bch_payload.data(), &config.cell, &sfn);
+            sfn = (sfn + sfn_offset) % kMaxSfn;
+          }
+        });
         _tti =  sfn * kSubframesPerFrame;
         return true;
       }
@@ -161,8 +163,10 @@ auto Phy::cell_search() -> bool {
       return false;
     }
 
-    _cell = new_cell;
-    _cell.mbsfn_prb = _cell.nof_prb;
+    _config.update([&new_cell](Config& config) {
+      config.cell = new_cell;
+      config.cell.mbsfn_prb = new_cell.nof_prb;
+    });
 
     if (srsran_ue_sync_set_cell(&_ue_sync, cell()) != 0) {
       spdlog::error("Phy: failed to set cell.\n");
@@ -221,54 +225,66 @@ auto Phy::get_next_frame(cf_t** buffer, uint32_t size) -> bool {
   return 1 == srsran_ue_sync_zerocopy(&_ue_sync, buffer, size);
 }
 
+void Phy::reset() {
+  _config.update([](Config& config) {
+    config.mcch_configured = false;
+    config.mch_configured = false;
+    // The TMGIs may be assigned differently after a resync
+    config.mch_generation++;
+  });
+}
+
+void Phy::set_nof_mbsfn_prb(uint8_t prb) {
+  _config.update([prb](Config& config) { config.cell.mbsfn_prb = prb; });
+}
+
 void Phy::set_mch_scheduling_info(const srsran::sib13_t& sib13) {
   if (sib13.nof_mbsfn_area_info > 1) {
     spdlog::warn("SIB13 has {} MBSFN area info elements - only 1 supported", sib13.nof_mbsfn_area_info);
   }
 
-  if (sib13.mbsfn_area_info_list[0].pmch_bandwidth != 0) {
-    _cell.mbsfn_prb = sib13.mbsfn_area_info_list[0].pmch_bandwidth;
-  }
+  _config.update([&sib13](Config& config) {
+    if (sib13.mbsfn_area_info_list[0].pmch_bandwidth != 0) {
+      config.cell.mbsfn_prb = sib13.mbsfn_area_info_list[0].pmch_bandwidth;
+    }
 
-  if (sib13.nof_mbsfn_area_info > 0) {
-    _sib13 = sib13;
+    if (sib13.nof_mbsfn_area_info > 0) {
+      config.sib13 = sib13;
+
+      bzero(&config.mcch_table[0], sizeof(uint8_t) * 10);
+      if (sib13.mbsfn_area_info_list[0].mcch_cfg.sf_alloc_info_is_r16) {
+        generate_mcch_table_r16(
+            &config.mcch_table[0],
+            static_cast<uint32_t>(
+              sib13.mbsfn_area_info_list[0].mcch_cfg.sf_alloc_info));
+      } else {
+        generate_mcch_table(
+            &config.mcch_table[0],
+            static_cast<uint32_t>(
+              sib13.mbsfn_area_info_list[0].mcch_cfg.sf_alloc_info));
+      }
 
-    bzero(&_mcch_table[0], sizeof(uint8_t) * 10);
-    if (sib13.mbsfn_area_info_list[0].mcch_cfg.sf_alloc_info_is_r16) {
-      generate_mcch_table_r16(
-          &_mcch_table[0],
-          static_cast<uint32_t>(
-            sib13.mbsfn_area_info_list[0].mcch_cfg.sf_alloc_info));
-    } else {
-      generate_mcch_table(
-          &_mcch_table[0],
-          static_cast<uint32_t>(
-            sib13.mbsfn_area_info_list[0].mcch_cfg.sf_alloc_info));
-    }
+      std::stringstream ss;
+      ss << "|";
+      for (unsigned char j : config.mcch_table) {
+        ss << static_cast<int>(j) << "|";
+      }
+      spdlog::debug("MCCH table: {}", ss.str());
 
-    std::stringstream ss;
-    ss << "|";
-    for (unsigned char j : _mcch_table) {
-      ss << static_cast<int>(j) << "|";
+      config.mcch_configured = true;
     }
-    spdlog::debug("MCCH table: {}", ss.str());
-
-    _mcch_configured = true;
-  }
+  });
 }
 
 void Phy::set_mbsfn_config(const srsran::mcch_msg_t& mcch) {
-  _mcch = mcch;
-  _mch_configured = true;
-
-  _mch_info.clear();
-  for (uint32_t i = 0; i < _mcch.nof_pmch_info; i++) {
+  std::vector< mch_info_t > mch_infos;
+  for (uint32_t i = 0; i < mcch.nof_pmch_info; i++) {
     mch_info_t mch_info;
-    mch_info.mcs = _mcch.pmch_info_list[i].data_mcs;
+    mch_info.mcs = mcch.pmch_info_list[i].data_mcs;
 
-    for (uint32_t j = 0; j < _mcch.pmch_info_list[i].nof_mbms_session_info; j++) {
+    for (uint32_t j = 0; j < mcch.pmch_info_list[i].nof_mbms_session_info; j++) {
       mtch_info_t mtch_info;
-      mtch_info.lcid = _mcch.pmch_info_list[i].mbms_session_info_list[j].lc_ch_id;
+      mtch_info.lcid = mcch.pmch_info_list[i].mbms_session_info_list[j].lc_ch_id;
       char tmgi[20]; // NOLINT
       /* acc to  TS24.008 10.5.6.13:
        * MCC 1,2,3: 901 ->   9, 0, 1
@@ -284,25 +300,32 @@ void Phy::set_mbsfn_config(const srsran::mcch_msg_t& mcch) {
        * -------------+-------------+---------
        */
       sprintf (tmgi, "%06x%02x%02x%02x",
-         _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.serviced_id[2] |
-         _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.serviced_id[1] << 8 |
-         _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.serviced_id[0] << 16 , 
-         _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mcc[1] << 4 | mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mcc[0],
-         ( _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.nof_mnc_digits == 2 ? 0xF : _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[2] ) << 4 | _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mcc[2] ,
-         _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[1] << 4 | _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[0]
+         mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.serviced_id[2] |
+         mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.serviced_id[1] << 8 |
+         mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.serviced_id[0] << 16 , 
+         mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mcc[1] << 4 | mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mcc[0],
+         ( mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.nof_mnc_digits == 2 ? 0xF : mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[2] ) << 4 | mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mcc[2] ,
+         mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[1] << 4 | mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[0]
          );
       mtch_info.tmgi = tmgi;
-      mtch_info.dest = _dests[i][mtch_info.lcid];
       mch_info.mtchs.push_back(mtch_info);
     }
 
-    _mch_info.push_back(mch_info);
+    mch_infos.push_back(mch_info);
   }
+
+  // Decoding continues with the previous configuration until the new one is published
+  _config.update([&mcch, &mch_infos](Config& config) {
+    config.mcch = mcch;
+    config.mch_configured = true;
+    config.mch_info = std::move(mch_infos);
+    config.mch_generation++;
+  });
 }
 
 auto Phy::is_cas_subframe(unsigned tti) -> bool
 {
-  if (_cell.mbms_dedicated) {
+  if (_config.read()->cell.mbms_dedicated) {
     // This is subframe 0 in a radio frame divisible by 4, and hence a CAS frame. 
     return tti%40 == 0;
   } else {
@@ -313,7 +336,7 @@ auto Phy::is_cas_subframe(unsigned tti) -> bool
 
 auto Phy::is_mbsfn_subframe(unsigned tti) -> bool
 {
-  if (_cell.mbms_dedicated) {
+  if (_config.read()->cell.mbms_dedicated) {
     // This is subframe 0 in a radio frame divisible by 4, and hence a CAS frame. 
     return !is_cas_subframe(tti);
   } else {
@@ -323,11 +346,11 @@ auto Phy::is_mbsfn_subframe(unsigned tti) -> bool
 }
 auto Phy::mbsfn_config_for_tti(uint32_t tti, unsigned& area)
     -> srsran_mbsfn_cfg_t {
-  srsran_mbsfn_cfg_t cfg;
-  cfg.enable                  = false;
-  cfg.is_mcch                 = false;
+  srsran_mbsfn_cfg_t cfg = {};
 
-  if (!_mcch_configured) {
+  // One consistent snapshot for the whole subframe, even if SIB13 / MCCH are updated meanwhile
+  auto config = _config.read();
+  if (!config->mcch_configured) {
     {
       return cfg;
     }
@@ -336,13 +359,13 @@ auto Phy::mbsfn_config_for_tti(uint32_t tti, unsigned& area)
   uint32_t sfn = tti / 10;
   uint8_t sf = tti % 10;
 
-  srsran::mbsfn_area_info_t& area_info = _sib13.mbsfn_area_info_list[0];
+  const srsran::mbsfn_area_info_t& area_info = config->sib13.mbsfn_area_info_list[0];
 
   cfg.mbsfn_area_id = area_info.mbsfn_area_id;
   cfg.non_mbsfn_region_length = enum_to_number(area_info.non_mbsfn_region_len);
 
   if (sfn % enum_to_number(area_info.mcch_cfg.mcch_repeat_period) == area_info.mcch_cfg.mcch_offset &&
-      _mcch_table[sf] == 1) {
+      config->mcch_table[sf] == 1) {
     // MCCH
     if (_decode_mcch) {
       cfg.mbsfn_mcs               = enum_to_number(area_info.mcch_cfg.sig_mcs);
@@ -355,26 +378,26 @@ auto Phy::mbsfn_config_for_tti(uint32_t tti, unsigned& area)
       cfg.enable                  = true;
       cfg.is_mcch                 = false;
   } else {
-    if (_mch_configured) {
+    if (config->mch_configured) {
       cfg.mbsfn_area_id = area_info.mbsfn_area_id;
 
-      for (uint32_t i = 0; i < _mcch.nof_pmch_info; i++) {
-        unsigned fn_in_scheduling_period =  sfn % enum_to_number(_mcch.pmch_info_list[i].mch_sched_period);
+      for (uint32_t i = 0; i < config->mcch.nof_pmch_info; i++) {
+        unsigned fn_in_scheduling_period =  sfn % enum_to_number(config->mcch.pmch_info_list[i].mch_sched_period);
         unsigned sf_idx = fn_in_scheduling_period * 10 + sf 
           - (fn_in_scheduling_period / 4) // minus 1 CAS SF per 4 SFNs 
           - 1; // minus 1 MCCH SF per scheduling period;
 
         spdlog::debug("i {}, tti {}, fn_in_ {}, sf_idx {}", i, tti, fn_in_scheduling_period,  sf_idx);
 
-        if (sf_idx <= _mcch.pmch_info_list[i].sf_alloc_end) {
+        if (sf_idx <= config->mcch.pmch_info_list[i].sf_alloc_end) {
           area = i;
           if ((i == 0 && fn_in_scheduling_period == 0 && sf == 1) ||
-              (i > 0 && _mcch.pmch_info_list[i-1].sf_alloc_end + 1 == sf_idx)) {
+              (i > 0 && config->mcch.pmch_info_list[i-1].sf_alloc_end + 1 == sf_idx)) {
             spdlog::debug("assigning sig_mcs {}, mch_idx is {}",  area_info.mcch_cfg.sig_mcs, area);
             cfg.mbsfn_mcs = enum_to_number(area_info.mcch_cfg.sig_mcs);
           } else {
-            spdlog::debug("assigning pmch_mcs {}, mch_idx is {}", _mcch.pmch_info_list[i].data_mcs, area);
-            cfg.mbsfn_mcs = _mcch.pmch_info_list[i].data_mcs;
+            spdlog::debug("assigning pmch_mcs {}, mch_idx is {}", config->mcch.pmch_info_list[i].data_mcs, area);
+            cfg.mbsfn_mcs = config->mcch.pmch_info_list[i].data_mcs;
           }
           cfg.enable = true;
           break;
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <cstdint>
 #include <string>
@@ -32,7 +33,12 @@
 #include "srsran/common/gen_mch_tables.h"
 #include "srsran/phy/common/phy_common.h"
 
+#include "FlowTable.h"
+#include "RcuPointer.h"
+
 constexpr unsigned int MAX_PRB = 100;
+constexpr unsigned int MIN_PRB = 6;
+constexpr unsigned int MAX_MCH = 15;  // PMCHs per MBSFN area, size of srsran::mcch_msg_t::pmch_info_list
 
 /**
  *  The PHY component. Handles synchronisation and is the central hub for
@@ -46,6 +52,80 @@ class Phy {
      */
     typedef std::function<int(cf_t* data[SRSRAN_MAX_CHANNELS], uint32_t nsamples, srsran_timestamp_t* rx_time)> get_samples_t;
 
+    typedef struct {
+      std::string tmgi;
+      int lcid;
+    } mtch_info_t;
+    typedef struct {
+      int mcs;
+      std::vector< mtch_info_t > mtchs;
+    } mch_info_t;
+
+    enum class SubcarrierSpacing {
+      df_15kHz,
+      df_7kHz5,
+      df_1kHz25
+    };
+
+    /**
+     *  Cell and MBSFN configuration, as received in MIB, SIB13 and MCCH.
+     *
+     *  Published as an immutable snapshot, see config(). Readers get a consistent view without locks
+     *  or copies. Every change publishes a new version.
+     */
+    struct Config {
+      srsran_cell_t cell = {};
+      bool mcch_configured = false;
+      bool mch_configured = false;
+      srsran::sib13_t sib13 = {};
+      uint8_t mcch_table[10] = {};
+      srsran::mcch_msg_t mcch = {};
+      std::vector< mch_info_t > mch_info;
+      uint64_t mch_generation = 0;  /**< Incremented whenever mch_info is replaced or may be outdated */
+
+      /**
+       *  TMGI of the MTCH on an MCH / LCID. Empty if it is not (yet) known.
+       *
+       *  Callers that cache the result must drop their cache when mch_generation changes.
+       */
+      std::string tmgi(uint32_t mch_idx, uint32_t lcid) const {
+        if (mch_idx < mch_info.size()) {
+          for (const auto& mtch : mch_info[mch_idx].mtchs) {
+            if (mtch.lcid == static_cast<int>(lcid)) {
+              return mtch.tmgi;
+            }
+          }
+        }
+        return {};
+      }
+
+      SubcarrierSpacing mbsfn_subcarrier_spacing() const {
+        if (cell.mbms_dedicated) {
+          switch (sib13.mbsfn_area_info_list[0].subcarrier_spacing) {
+            case srsran::mbsfn_area_info_t::subcarrier_spacing_t::khz_1dot25: return SubcarrierSpacing::df_1kHz25;
+            case srsran::mbsfn_area_info_t::subcarrier_spacing_t::khz_7dot5: return SubcarrierSpacing::df_7kHz5;
+            default: return SubcarrierSpacing::df_15kHz;
+          }
+        } else {
+            return SubcarrierSpacing::df_15kHz;
+        }
+      }
+
+      float mbsfn_subcarrier_spacing_khz() const {
+        switch (mbsfn_subcarrier_spacing()) {
+          case SubcarrierSpacing::df_1kHz25: return 1.25;
+          case SubcarrierSpacing::df_7kHz5: return 7.5;
+          default: return 15;
+        }
+      }
+    };
+
+    /**
+     *  Read access to the current configuration snapshot. Keeps it alive while in scope, and must
+     *  only be held for a short time.
+     */
+    typedef RcuPointer<Config>::ReadGuard config_t;
+
     /**
      *  Default constructor.
      *
@@ -89,13 +169,18 @@ class Phy {
      * Get the current cell (with params adjusted for MBSFN)
      */
     srsran_cell_t cell() { 
-      return _cell;
+      return _config.read()->cell;
     }
 
+    /**
+     * Get the current configuration snapshot
+     */
+    config_t config() const { return _config.read(); }
+
     /**
      * Get the current number of PRB.
      */
-    unsigned nr_prb() { return _cell.nof_prb; }
+    unsigned nr_prb() { return _config.read()->cell.nof_prb; }
 
     /**
      * Get the current subframe TTI
@@ -125,17 +210,17 @@ class Phy {
     /**
      * Clear configuration values
      */
-    void reset() { _mcch_configured = _mch_configured = false; }
+    void reset();
 
     /**
      * Return true if MCCH has been configured
      */
-    bool mcch_configured() { return _mcch_configured; }
+    bool mcch_configured() { return _config.read()->mcch_configured; }
 
     /**
      * Returns the current MBSFN area ID
      */
-    uint8_t mbsfn_area_id() { return _sib13.mbsfn_area_info_list[0].mbsfn_area_id; }
+    uint8_t mbsfn_area_id() { return _config.read()->sib13.mbsfn_area_info_list[0].mbsfn_area_id; }
 
     /**
      * Returns the MBSFN configuration (MCS, etc) for the subframe with the passed TTI
@@ -150,65 +235,33 @@ class Phy {
     /**
      * Get number of PRB in MBSFN/PMCH
      */
-    uint8_t nof_mbsfn_prb() { return _cell.mbsfn_prb; }
+    uint8_t nof_mbsfn_prb() { return _config.read()->cell.mbsfn_prb; }
 
     /**
      * Override number of PRB in MBSFN/PMCH
      */
-    void set_nof_mbsfn_prb(uint8_t prb) { _cell.mbsfn_prb = prb; }
+    void set_nof_mbsfn_prb(uint8_t prb);
 
     void set_cell();
 
     bool is_cas_subframe(unsigned tti);
     bool is_mbsfn_subframe(unsigned tti);
 
-    typedef struct {
-      std::string tmgi;
-      std::string dest;
-      int lcid;
-    } mtch_info_t;
-    typedef struct {
-      int mcs;
-      std::vector< mtch_info_t > mtchs;
-    } mch_info_t;
-
-    const std::vector< mch_info_t>& mch_info() { return _mch_info;  }
-
-    void set_dest_for_lcid(uint32_t mch_idx, int lcid, std::string dest) { _dests[mch_idx][lcid] = dest; }
-
-    enum class SubcarrierSpacing {
-      df_15kHz,
-      df_7kHz5,
-      df_1kHz25
-    };
+    /**
+     * Get a copy of the MCH / MTCH info. Use config() to read it without copying.
+     */
+    std::vector< mch_info_t> mch_info() { return _config.read()->mch_info; }
 
-    SubcarrierSpacing mbsfn_subcarrier_spacing() {
-      if (_cell.mbms_dedicated) {
-        switch (_sib13.mbsfn_area_info_list[0].subcarrier_spacing) {
-          case srsran::mbsfn_area_info_t::subcarrier_spacing_t::khz_1dot25: return SubcarrierSpacing::df_1kHz25;
-          case srsran::mbsfn_area_info_t::subcarrier_spacing_t::khz_7dot5: return SubcarrierSpacing::df_7kHz5;
-          default: return SubcarrierSpacing::df_15kHz;
-        }
-      } else {
-          return SubcarrierSpacing::df_15kHz;
-      }
-    }
+    /**
+     * Destinations of the packets received on each MCH / LCID
+     */
+    FlowTable& flows() { return _flows; }
 
-    float mbsfn_subcarrier_spacing_khz() {
-      if (_cell.mbms_dedicated) {
-        switch (_sib13.mbsfn_area_info_list[0].subcarrier_spacing) {
-          case srsran::mbsfn_area_info_t::subcarrier_spacing_t::khz_1dot25: return 1.25;
-          case srsran::mbsfn_area_info_t::subcarrier_spacing_t::khz_7dot5: return 7.5;
-          default: return 15;
-        }
-      } else {
-          return 15;
-      }
-    }
+    SubcarrierSpacing mbsfn_subcarrier_spacing() { return _config.read()->mbsfn_subcarrier_spacing(); }
 
-    srsran::mcch_msg_t& mcch() { return _mcch; }
+    float mbsfn_subcarrier_spacing_khz() { return _config.read()->mbsfn_subcarrier_spacing_khz(); }
 
-    int _mcs = 0;
+    std::atomic<int> _mcs = {0};
     get_samples_t _sample_cb;
 
  private:
@@ -217,26 +270,17 @@ class Phy {
     srsran_ue_cellsearch_t _cell_search = {};
     srsran_ue_mib_sync_t  _mib_sync = {};
     srsran_ue_mib_t  _mib = {};
-    srsran_cell_t _cell = {};
 
-    bool _decode_mcch = false;
+    RcuPointer<Config> _config;
+    std::atomic<bool> _decode_mcch = {false};
 
     cf_t* _mib_buffer[SRSRAN_MAX_CHANNELS] = {};
     uint32_t _buffer_max_samples = 0;
     uint32_t _tti = 0;
 
-    uint8_t  _mcch_table[10] = {};
-    bool _mcch_configured = false;
-    srsran::sib13_t _sib13 = {};
-    srsran::mcch_msg_t _mcch = {};
-
-    bool _mch_configured = false;
-
     uint8_t _cs_nof_prb;
 
-    std::vector< mch_info_t > _mch_info;
-
-    std::map< uint32_t, std::map< int, std::string >> _dests;
+    FlowTable _flows = {MAX_MCH, SRSRAN_N_MCH_LCIDS};
 
     int8_t _override_nof_prb;
     uint8_t _rx_channels;
@@ -0,0 +1,67 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "PmchSequenceCache.h"
+
+#include <cstdlib>
+
+#include "spdlog/spdlog.h"
+
+PmchSequenceCache::~PmchSequenceCache() {
+  for (auto& entry : _seqs) {
+    for (auto& seq : entry.second->seq) {
+      srsran_sequence_free(&seq);
+    }
+    free(entry.second);
+  }
+}
+
+auto PmchSequenceCache::get(uint16_t area_id, uint32_t max_re) -> srsran_pmch_seq_t* {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto key = std::make_pair(area_id, max_re);
+  auto it = _seqs.find(key);
+  if (it != _seqs.end()) {
+    return it->second;
+  }
+
+  auto seqs = static_cast<srsran_pmch_seq_t*>(calloc(1, sizeof(srsran_pmch_seq_t)));
+  if (seqs == nullptr) {
+    return nullptr;
+  }
+  uint32_t len = max_re * srsran_mod_bits_x_symbol(SRSRAN_MOD_64QAM);
+  for (uint32_t i = 0; i < SRSRAN_NOF_SF_X_FRAME; i++) {
+    if (srsran_sequence_pmch(&seqs->seq[i], 2 * i, area_id, len) != SRSRAN_SUCCESS) {
+      spdlog::error("Could not generate PMCH scrambling sequence for area {}", area_id);
+      for (auto& seq : seqs->seq) {
+        srsran_sequence_free(&seq);
+      }
+      free(seqs);
+      return nullptr;
+    }
+  }
+
+  _seqs[key] = seqs;
+  spdlog::info("Generated shared PMCH scrambling sequences for MBSFN area {} ({} bits per subframe)", area_id, len);
+  return seqs;
+}
+
+auto PmchSequenceCache::size() -> size_t {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _seqs.size();
+}
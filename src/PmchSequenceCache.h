@@ -0,0 +1,67 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+#include "srsran/srsran.h"
+
+/**
+ *  Shared PMCH scrambling sequences.
+ *
+ *  srsRAN generates the scrambling sequences for all 10 subframes of an MBSFN area in every
+ *  srsran_pmch_t, which amounts to megabytes per processor for a wide carrier (each sequence is
+ *  kept in bit, byte, short and float form). The cache generates them once per (area, max. RE)
+ *  and hands the same, read-only set to all MBSFN processors.
+ */
+class PmchSequenceCache {
+  public:
+    /**
+     *  Default constructor.
+     */
+    PmchSequenceCache() = default;
+
+    /**
+     *  Default destructor. Frees all sequences. Must outlive all processors using them.
+     */
+    virtual ~PmchSequenceCache();
+
+    PmchSequenceCache(const PmchSequenceCache&) = delete;
+    PmchSequenceCache& operator=(const PmchSequenceCache&) = delete;
+
+    /**
+     *  Get the sequences for the passed area, generating them on first use. Thread safe.
+     *
+     *  @param area_id MBSFN area ID
+     *  @param max_re Max. number of REs of the PMCH the sequences are used for
+     */
+    srsran_pmch_seq_t* get(uint16_t area_id, uint32_t max_re);
+
+    /**
+     *  Number of cached sequence sets
+     */
+    size_t size();
+
+  private:
+    std::mutex _mutex;
+    std::map<std::pair<uint16_t, uint32_t>, srsran_pmch_seq_t*> _seqs;
+};
@@ -0,0 +1,79 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ProcessorScaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "spdlog/spdlog.h"
+
+// MBSFN subframes arrive at most once per millisecond
+static const double kSubframeDurationUs = 1000.0;
+
+ProcessorScaler::ProcessorScaler(const libconfig::Config& cfg, unsigned max_processors)
+  : _max(std::max(max_processors, 1U)) {
+  cfg.lookupValue("modem.phy.scaling.enabled", _enabled);
+  cfg.lookupValue("modem.phy.scaling.min_threads", _min);
+  cfg.lookupValue("modem.phy.scaling.headroom", _headroom);
+  cfg.lookupValue("modem.phy.scaling.shrink_after", _shrink_after);
+  _min = std::min(std::max(_min, 1U), _max);
+
+  // Start fully provisioned. The set shrinks once real decode times are known.
+  _target = _max;
+  spdlog::info("MBSFN processor scaling {}: {} to {} processors, headroom {}",
+      _enabled ? "enabled" : "disabled", _min, _max, _headroom);
+}
+
+auto ProcessorScaler::evaluate(uint64_t decoded, uint64_t decode_us, uint64_t congested) -> unsigned {
+  auto window_decoded = decoded - _last_decoded;
+  auto window_us = decode_us - _last_decode_us;
+  bool was_congested = congested != _last_congested;
+  _last_decoded = decoded;
+  _last_decode_us = decode_us;
+  _last_congested = congested;
+
+  if (!_enabled || window_decoded == 0) {
+    return _target;
+  }
+
+  auto avg_us = static_cast<double>(window_us) / window_decoded;
+  _decode_time_us = _decode_time_us == 0 ? avg_us : _alpha * avg_us + (1 - _alpha) * _decode_time_us;
+
+  auto needed = static_cast<unsigned>(std::ceil(_decode_time_us * _headroom / kSubframeDurationUs));
+  if (was_congested) {
+    needed = std::max(needed, _target + 1);
+  }
+  needed = std::min(std::max(needed, _min), _max);
+
+  if (needed > _target) {
+    spdlog::info("Decode time {:.0f} us, growing to {} MBSFN processors", _decode_time_us, needed);
+    _target = needed;
+    _calm_intervals = 0;
+  } else if (needed < _target) {
+    if (++_calm_intervals >= _shrink_after) {
+      _target--;
+      _calm_intervals = 0;
+      spdlog::info("Decode time {:.0f} us, shrinking to {} MBSFN processors", _decode_time_us, _target);
+    }
+  } else {
+    _calm_intervals = 0;
+  }
+  return _target;
+}
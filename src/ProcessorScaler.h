@@ -0,0 +1,87 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <libconfig.h++>
+
+/**
+ *  Chooses the number of active MBSFN processors / PHY workers at runtime.
+ *
+ *  The required parallelism depends on PRB count, subcarrier spacing and MCS, which are only
+ *  known once MCCH has been acquired. The scaler is fed with the cumulative decode time counters
+ *  in regular intervals, keeps a moving average of the per-subframe decode time, and sizes the
+ *  active set so that this time is covered at one subframe per millisecond, with some headroom.
+ *  It grows immediately, and shrinks one step at a time after a few calm intervals.
+ */
+class ProcessorScaler {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param max_processors Number of available processors (upper bound)
+     */
+    ProcessorScaler(const libconfig::Config& cfg, unsigned max_processors);
+
+    /**
+     *  Default destructor.
+     */
+    virtual ~ProcessorScaler() = default;
+
+    /**
+     *  Evaluate the counters accumulated since the last call, and return the new target.
+     *
+     *  @param decoded Cumulative number of decoded subframes
+     *  @param decode_us Cumulative decode time
+     *  @param congested Cumulative number of stalls and drops caused by busy processors
+     */
+    unsigned evaluate(uint64_t decoded, uint64_t decode_us, uint64_t congested);
+
+    /**
+     *  Current number of active processors
+     */
+    unsigned target() const { return _target; }
+
+    /**
+     *  Moving average of the per-subframe decode time
+     */
+    double decode_time_us() const { return _decode_time_us; }
+
+    bool enabled() const { return _enabled; }
+    unsigned min_processors() const { return _min; }
+    unsigned max_processors() const { return _max; }
+
+  private:
+    bool _enabled = true;
+    unsigned _min = 1;
+    unsigned _max = 1;
+    unsigned _target = 1;
+    double _headroom = 1.5;
+    double _alpha = 0.2;
+    unsigned _shrink_after = 10;
+
+    double _decode_time_us = 0;
+    unsigned _calm_intervals = 0;
+
+    uint64_t _last_decoded = 0;
+    uint64_t _last_decode_us = 0;
+    uint64_t _last_congested = 0;
+};
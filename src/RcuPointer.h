@@ -0,0 +1,148 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ *  Pointer to an immutable object that is replaced as a whole, with read-copy-update semantics.
+ *
+ *  Readers take a ReadGuard, which pins the current object until the guard goes out of scope.
+ *  Taking and releasing a guard is one atomic increment and decrement, without locks and without
+ *  copying the object. All reads through one guard see the same, consistent version.
+ *
+ *  Writers copy the current object, modify the copy and publish it. The old version is deleted once
+ *  all readers that could still see it have released their guards (the grace period). Readers are
+ *  counted in two alternating groups: publishing moves new readers to the other group and waits for
+ *  the previous group to drain. Writers are serialized by a mutex and wait for the grace period, so
+ *  updates should be rare, and readers must only hold a guard for a short time. A thread must not
+ *  update while it holds a guard itself.
+ */
+template <class T>
+class RcuPointer {
+  public:
+    /**
+     *  Read access to the current version. Keeps it alive while in scope.
+     */
+    class ReadGuard {
+      public:
+        explicit ReadGuard(const RcuPointer& rcu)
+          : _rcu(&rcu)
+          , _group(rcu.enter())
+          , _ptr(rcu._current.load(std::memory_order_acquire))
+        {}
+
+        ReadGuard(ReadGuard&& other) noexcept
+          : _rcu(other._rcu)
+          , _group(other._group)
+          , _ptr(other._ptr) {
+          other._rcu = nullptr;
+        }
+
+        ~ReadGuard() {
+          if (_rcu != nullptr) {
+            _rcu->leave(_group);
+          }
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ReadGuard& operator=(ReadGuard&&) = delete;
+
+        const T* operator->() const { return _ptr; }
+        const T& operator*() const { return *_ptr; }
+
+      private:
+        const RcuPointer* _rcu;
+        unsigned _group;
+        const T* _ptr;
+    };
+
+    /**
+     *  Default constructor. Publishes a default constructed object.
+     */
+    RcuPointer()
+      : _current(new T()) {}
+
+    /**
+     *  Default destructor. Must not be called while readers hold a guard.
+     */
+    virtual ~RcuPointer() { delete _current.load(); }
+
+    RcuPointer(const RcuPointer&) = delete;
+    RcuPointer& operator=(const RcuPointer&) = delete;
+
+    /**
+     *  Get read access to the current version
+     */
+    ReadGuard read() const { return ReadGuard(*this); }
+
+    /**
+     *  Publish a modified copy of the current version, and delete the old one after the grace period.
+     *
+     *  @param modify Called with the copy, before it is published
+     */
+    template <class F>
+    void update(F&& modify) {
+      std::lock_guard<std::mutex> lock(_write_mutex);
+      auto next = std::make_unique<T>(*_current.load(std::memory_order_relaxed));
+      modify(*next);
+      auto old = _current.exchange(next.release());
+
+      // Readers that enter from now on see the new version. Wait for those that may still see the old one.
+      auto epoch = _epoch.fetch_add(1);
+      while (_readers[epoch & 1].count.load() != 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+      }
+      delete old;
+    }
+
+  private:
+    unsigned enter() const {
+      for (;;) {
+        auto epoch = _epoch.load();
+        _readers[epoch & 1].count.fetch_add(1);
+        if (_epoch.load() == epoch) {
+          return static_cast<unsigned>(epoch & 1);
+        }
+        // A writer has moved on in between. It may not wait for this group, so join the current one.
+        _readers[epoch & 1].count.fetch_sub(1);
+      }
+    }
+
+    void leave(unsigned group) const {
+      _readers[group].count.fetch_sub(1, std::memory_order_release);
+    }
+
+    struct alignas(64) ReaderGroup {
+      std::atomic<uint64_t> count = {0};
+    };
+
+    std::atomic<T*> _current;
+    std::atomic<uint64_t> _epoch = {0};
+    mutable ReaderGroup _readers[2];
+    std::mutex _write_mutex;
+};
@@ -0,0 +1,843 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "ReceiveChain.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#include "DecoderConfig.h"
+#include "spdlog/spdlog.h"
+
+using std::placeholders::_1;
+using std::placeholders::_2;
+using std::placeholders::_3;
+using std::placeholders::_4;
+using std::placeholders::_5;
+
+/**
+ * Worker pool entry point for CAS subframes.
+ */
+static void process_cas(void* obj, uint32_t tti) {
+  static_cast<CasFrameProcessor*>(obj)->process(tti);
+}
+
+/**
+ * Worker pool entry point for the PMCH decode stage of MBSFN subframes.
+ */
+static void decode_mbsfn(void* obj, uint32_t tti) {
+  static_cast<MbsfnFrameProcessor*>(obj)->decode(tti);
+}
+
+/**
+ * Worker pool entry point for MBSFN subframes. Runs FFT / channel estimation, and hands the
+ * subframe to the decode stage if pipelining is enabled.
+ */
+static void process_mbsfn(void* obj, uint32_t tti) {
+  auto processor = static_cast<MbsfnFrameProcessor*>(obj);
+  auto decode_pool = processor->decode_pool();
+  if (decode_pool == nullptr) {
+    processor->process(tti);
+    return;
+  }
+  if (processor->estimate(tti) &&
+      !decode_pool->push(decode_mbsfn, decode_mbsfn, processor, tti, std::chrono::microseconds(0), processor->id())) {
+    // Decode stage backlogged, decode on this thread
+    processor->decode(tti);
+  }
+}
+
+/**
+ * Worker pool entry point for late CAS subframes.
+ */
+static void skip_cas(void* obj, uint32_t tti) {
+  static_cast<CasFrameProcessor*>(obj)->skip(tti);
+}
+
+/**
+ * Worker pool entry point for late MBSFN subframes.
+ */
+static void skip_mbsfn(void* obj, uint32_t tti) {
+  static_cast<MbsfnFrameProcessor*>(obj)->skip(tti);
+}
+
+ReceiveChain::~ReceiveChain() {
+  // Queued jobs point to the processors. Stop the workers before freeing them. The FFT/CE stage
+  // hands jobs to the decode pool, so it goes first. Jobs still queued are dropped.
+  _pool.reset();
+  _decode_pool.reset();
+  // The processors hold on to the reorder buffer and the sequence cache, free them first
+  _mbsfn_processors.clear();
+  for (auto& buf : _drop_buffer) {
+    free(buf);
+  }
+}
+
+/**
+ * Set new SDR parameters and initialize resynchronisation. This function is used by the RESTful API handler
+ * to modify the SDR params.
+ *
+ * @param ant  Name of the antenna input (For LimeSDR Mini: LNAW, LNAL)
+ * @param fc   Center frequency to tune to (in Hz)
+ * @param g    Total system gain to set [0..1]
+ * @param sr   Sample rate (in Hz)
+ * @param bw   Low pass filter bandwidth (in Hz)
+ */
+void ReceiveChain::set_params(const std::string& ant, unsigned fc, double g, unsigned sr, unsigned bw) {
+  _sample_rate = sr;
+  _frequency = fc;
+  _bandwidth = bw;
+  _antenna = ant;
+  _gain = g;
+  spdlog::info("RESTful API requesting new parameters: fc {}, bw {}, rate {}, gain {}, antenna {}",
+      _frequency, _bandwidth, _sample_rate, _gain, _antenna);
+
+  _restart = true;
+}
+
+auto ReceiveChain::init() -> bool {
+  // Init and tune the SDR
+  _cfg.lookupValue("modem.sdr.rx_channels", _rx_channels);
+  spdlog::info("Initialising SDR with {} RX channel(s)", _rx_channels);
+  _sdr = std::make_unique<SdrReader>(_cfg, _rx_channels);
+
+  std::string sdr_dev = "driver=lime";
+  _cfg.lookupValue("modem.sdr.device_args", sdr_dev);
+  if (!_sdr->init(sdr_dev,
+        _options.sample_file.empty() ? nullptr : _options.sample_file.c_str(),
+        _options.write_sample_file.empty() ? nullptr : _options.write_sample_file.c_str())) {
+    spdlog::error("Failed to initialize I/Q data source.");
+    return false;
+  }
+
+  // srsRAN derives all sample rates and buffer sizes from the FFT size. With the standard symbol sizes,
+  // a 20 MHz carrier is received at 30.72 Msps. The reduced sizes bring this down to 23.04 Msps.
+  bool standard_symbol_size = true;
+  _cfg.lookupValue("modem.phy.standard_symbol_size", standard_symbol_size);
+  srsran_use_standard_symbol_size(standard_symbol_size);
+
+  // Cell search runs with 25 PRB, or at the bandwidth of the sample file
+  uint8_t search_nof_prb = _options.file_bw ? _options.file_bw * 5 : 25;
+  _sample_rate = static_cast<unsigned>(srsran_sampling_freq_hz(search_nof_prb));
+  if (_cfg.lookupValue("modem.sdr.search_sample_rate_hz", _sample_rate) &&
+      _sample_rate != static_cast<unsigned>(srsran_sampling_freq_hz(search_nof_prb))) {
+    spdlog::warn("Configured search sample rate {} Hz does not match {} PRB with {} symbol sizes ({} Hz)",
+        _sample_rate, search_nof_prb, standard_symbol_size ? "standard" : "reduced",
+        srsran_sampling_freq_hz(search_nof_prb));
+  }
+  _search_sample_rate = _sample_rate;
+  spdlog::info("Using {} symbol sizes, search sample rate {} Msps", standard_symbol_size ? "standard" : "reduced",
+      _search_sample_rate / 1000000.0);
+
+  unsigned long long center_frequency = _frequency;
+  if (!_cfg.lookupValue("modem.sdr.center_frequency_hz", center_frequency)) {
+    spdlog::error("Unable to parse center_frequency_hz - values must have a ‘L’ character appended");
+    return false;
+  }
+  // We needed unsigned long long for correct parsing,
+  // but unsigned is required
+  if (center_frequency <= UINT_MAX) {
+     _frequency = static_cast<unsigned>(center_frequency);
+  } else {
+    spdlog::error("Configured center_frequency_hz is {}, maximal value supported is {}.",
+        center_frequency, UINT_MAX);
+    return false;
+  }
+
+  _cfg.lookupValue("modem.sdr.normalized_gain", _gain);
+  _cfg.lookupValue("modem.sdr.antenna", _antenna);
+  _cfg.lookupValue("modem.sdr.use_agc", _use_agc);
+
+  if (!_sdr->tune(_frequency, _sample_rate, _bandwidth, _gain, _antenna, _use_agc)) {
+    spdlog::error("Failed to set initial center frequency.");
+    return false;
+  }
+
+  set_srsran_verbose_level(_options.log_level <= 1 ? SRSRAN_VERBOSE_DEBUG : SRSRAN_VERBOSE_NONE);
+
+  // Load the FFT plans measured in previous runs. Needs to happen before the first plan is created.
+  _fft_wisdom = std::make_unique<FftWisdom>(_cfg);
+
+  // Create a thread pool for the frame processors. modem.phy.threads is the upper bound,
+  // the number of active workers is scaled at runtime.
+  _cfg.lookupValue("modem.phy.threads", _thread_cnt);
+  int phy_prio = 10;
+  _cfg.lookupValue("modem.phy.thread_priority_rt", phy_prio);
+
+  // If enabled, PMCH decoding runs on a separate set of workers, so FFT / channel estimation of the next
+  // subframes overlaps with turbo decoding of the previous ones, and both stages can be sized independently.
+  unsigned decode_thread_cnt = 2;
+  _cfg.lookupValue("modem.phy.pipeline.decode_threads", decode_thread_cnt);
+  if (decode_thread_cnt > 0) {
+    _decode_pool = std::make_unique<WorkerPool>(decode_thread_cnt, phy_prio);
+  }
+  spdlog::info("MBSFN pipeline: {}", decode_thread_cnt > 0 ?
+      std::to_string(_thread_cnt) + " FFT/CE workers, " + std::to_string(decode_thread_cnt) + " PMCH decode workers" :
+      std::string("disabled"));
+
+  _pool = std::make_unique<WorkerPool>(_thread_cnt + 1, phy_prio);
+
+  // Processing deadlines per channel, measured from dispatch. A subframe that has not been picked up
+  // by a worker by then is skipped. The lowest priority channel (MTCH) has the shortest budget, so
+  // it is dropped first when the workers fall behind.
+  unsigned mtch_budget_ms = 4;
+  unsigned mcch_budget_ms = 8;
+  unsigned cas_budget_ms = 20;
+  _cfg.lookupValue("modem.phy.deadlines.mtch_ms", mtch_budget_ms);
+  _cfg.lookupValue("modem.phy.deadlines.mcch_ms", mcch_budget_ms);
+  _cfg.lookupValue("modem.phy.deadlines.cas_ms", cas_budget_ms);
+  _mtch_budget = std::chrono::microseconds(mtch_budget_ms * 1000);
+  _mcch_budget = std::chrono::microseconds(mcch_budget_ms * 1000);
+  _cas_budget = std::chrono::microseconds(cas_budget_ms * 1000);
+
+  _cfg.lookupValue("modem.measurement_file.enabled", _enable_measurement_file);
+  _measurement_file = std::make_unique<MeasurementFileWriter>(_cfg);
+
+  // Create the layer components: Phy, RLC, RRC and GW
+  _phy = std::make_unique<Phy>(
+      _cfg,
+      std::bind(&SdrReader::get_samples, _sdr.get(), _1, _2, _3),  // NOLINT
+      search_nof_prb,
+      _options.override_nof_prb,
+      _rx_channels);
+
+  auto planning_start = std::chrono::steady_clock::now();
+  _phy->init();
+  _fft_wisdom->add_planning_time(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - planning_start));
+
+  _state = searching;
+
+  // Create the RESTful API handler
+  std::string uri = "http://0.0.0.0:3010/modem-api/";
+  _cfg.lookupValue("modem.restful_api.uri", uri);
+  spdlog::info("Starting RESTful API handler at {}", uri);
+  _rest_handler = std::make_unique<RestHandler>(_cfg, uri, _state, *_sdr, *_phy,
+      std::bind(&ReceiveChain::set_params, this, _1, _2, _3, _4, _5));  // NOLINT
+
+  _pdcp = std::make_unique<srsran::pdcp>(nullptr, "PDCP");
+  _rlc = std::make_unique<srsran::rlc>("RLC");
+  _timers = std::make_unique<srsran::timer_handler>();
+
+  _rrc = std::make_unique<Rrc>(_cfg, *_phy, *_rlc);
+  _gw = std::make_unique<Gw>(_cfg, *_phy, *_rest_handler);
+  _gw->set_packet_callback(_packet_callback);
+  _gw->init();
+
+  _rlc->init(_pdcp.get(), _rrc.get(), _timers.get(), 0 /* RB_ID_SRB0 */);
+  _pdcp->init(_rlc.get(), _rrc.get(), _gw.get());
+
+  auto srs_level = srslog::basic_levels::none;
+  switch (_options.srs_log_level) {
+    case 0: srs_level = srslog::basic_levels::debug; break;
+    case 1: srs_level = srslog::basic_levels::info; break;
+    case 2: srs_level = srslog::basic_levels::warning; break;
+    case 3: srs_level = srslog::basic_levels::error; break;
+    case 4: srs_level = srslog::basic_levels::none; break;
+  }
+
+  // Configure srsLTE logging
+  auto& mac_log = srslog::fetch_basic_logger("MAC", false);
+  mac_log.set_level(srs_level);
+  auto& phy_log = srslog::fetch_basic_logger("PHY", false);
+  phy_log.set_level(srs_level);
+  auto& rlc_log = srslog::fetch_basic_logger("RLC", false);
+  rlc_log.set_level(srs_level);
+  auto& asn1_log = srslog::fetch_basic_logger("ASN1", false);
+  asn1_log.set_level(srs_level);
+
+  spdlog::info("Turbo decoders: PDSCH {}, MCCH {}, MTCH {}", DecoderConfig(_cfg, "pdsch").description(),
+      DecoderConfig(_cfg, "mcch").description(), DecoderConfig(_cfg, "mtch").description());
+
+  // Initialize one CAS and thread_cnt MBSFN frame processors
+  planning_start = std::chrono::steady_clock::now();
+  _cas_processor = std::make_unique<CasFrameProcessor>(_cfg, *_phy, *_rlc, *_rest_handler, _rx_channels);
+  if (!_cas_processor->init()) {
+    spdlog::error("Failed to create CAS processor.");
+    return false;
+  }
+
+  // Decoded MCH transport blocks pass through the reorder buffer, which hands them to the
+  // MAC demultiplexer / RLC in TTI order on its own delivery thread
+  _mch_demux = std::make_unique<MchDemux>(_cfg, *_phy, *_rlc, mac_log, *_rest_handler);
+  _mch_reorder = std::make_unique<MchReorderBuffer>(_cfg, *_rest_handler,
+      [this](const MchReorderBuffer::Slot& slot) {
+        _gw->begin_tb(slot.tti, slot.received);
+        _mch_demux->deliver(slot);
+        _gw->flush();
+      });
+
+  // All MBSFN processors start out idle. A processor is taken from the idle list for each MBSFN subframe,
+  // and returns itself to the list once processing has finished.
+  // Scrambling sequences are the same for all processors, they are generated only once.
+  _idle_processors = std::make_unique<MbsfnFrameProcessor::idle_list_t>(_thread_cnt);
+  for (unsigned i = 0; i < _thread_cnt; i++) {
+    auto p = std::make_unique<MbsfnFrameProcessor>(_cfg, *_phy, *_rest_handler, _rx_channels, *_idle_processors,
+        *_mch_reorder, i, _pmch_sequences);
+    if (!p->init()) {
+      spdlog::error("Failed to create MBSFN processor.");
+      return false;
+    }
+    p->set_decode_pool(_decode_pool.get());
+    _idle_processors->try_push(p.get());
+    _mbsfn_processors.push_back(std::move(p));
+  }
+
+  _fft_wisdom->add_planning_time(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - planning_start));
+  spdlog::info("PHY and frame processor init took {} ms, {} FFTW wisdom", _fft_wisdom->planning_time().count() / 1000,
+      _fft_wisdom->loaded() ? "with" : "without");
+  _fft_wisdom->save();
+
+  // The processors' buffers are sized for the narrowest carrier until a cell has been found
+  spdlog::info("Frame processor memory: CAS {} kB, MBSFN {} x {} kB. Resized to the carrier when syncing.",
+      _cas_processor->memory_footprint() / 1024, _thread_cnt, _mbsfn_processors[0]->memory_footprint() / 1024);
+
+  // Size the active processor / worker set from the measured decode time. Processors outside
+  // the active set are parked in a list only the main loop touches.
+  _scaler = std::make_unique<ProcessorScaler>(_cfg, _thread_cnt);
+  _parked_processors.reserve(_thread_cnt);
+  apply_scaling(_scaler->target());
+
+  // What to do if an MBSFN subframe arrives while all processors are busy: wait for one to become idle,
+  // or drop the subframe
+  std::string busy_policy = "wait";
+  _cfg.lookupValue("modem.phy.busy_processor_policy", busy_policy);
+  _drop_when_busy = (busy_policy == "drop");
+  spdlog::info("Busy MBSFN processor policy: {}", _drop_when_busy ? "drop" : "wait");
+
+  _drop_buffer_size = 3 * SRSRAN_SF_LEN_PRB(MAX_PRB);
+  for (auto ch = 0; ch < _rx_channels; ch++) {
+    _drop_buffer[ch] = srsran_vec_cf_malloc(_drop_buffer_size);
+    if (_drop_buffer[ch] == nullptr) {
+      spdlog::error("Failed to allocate the subframe drop buffer");
+      return false;
+    }
+  }
+
+  _cfg.lookupValue("modem.measurement_file.interval_secs", _measurement_interval);
+  _measurement_interval *= 1000;
+  return true;
+}
+
+void ReceiveChain::apply_scaling(unsigned target) {
+  for (auto it = _parked_processors.begin();
+      it != _parked_processors.end() && _thread_cnt - _parked_processors.size() < target; ) {
+    // Processors without buffers for the current bandwidth stay parked until the next sync resizes them
+    if ((*it)->nof_prb() != _mbsfn_nof_prb) {
+      ++it;
+      continue;
+    }
+    _idle_processors->try_push(*it);
+    it = _parked_processors.erase(it);
+  }
+  MbsfnFrameProcessor* p = nullptr;
+  while (_thread_cnt - _parked_processors.size() > target && _idle_processors->try_pop(p)) {
+    // Busy processors are parked on one of the next evaluations
+    _parked_processors.push_back(p);
+  }
+  auto active = static_cast<unsigned>(_thread_cnt - _parked_processors.size());
+  _pool->set_active_threads(active + 1);  // one more for CAS
+  _rest_handler->_mbsfn_dispatch.active_processors = active;
+  _rest_handler->_mbsfn_dispatch.decode_time_us = static_cast<unsigned>(_scaler->decode_time_us());
+}
+
+void ReceiveChain::resize_processors(uint32_t nof_prb) {
+  // Take all active processors off the idle list, so none of them can be dispatched while its
+  // buffers are reallocated. Subframes still in flight finish within their deadline.
+  std::vector<MbsfnFrameProcessor*> resizing(_parked_processors);
+  MbsfnFrameProcessor* p = nullptr;
+  for (unsigned wait_ms = 0; wait_ms < 1000 && resizing.size() < _mbsfn_processors.size(); ) {
+    if (_idle_processors->try_pop(p)) {
+      resizing.push_back(p);
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      wait_ms++;
+    }
+  }
+  if (resizing.size() < _mbsfn_processors.size()) {
+    spdlog::warn("{} MBSFN processors still busy, they are parked until the next sync",
+        _mbsfn_processors.size() - resizing.size());
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  unsigned resized = 0;
+  for (auto processor : resizing) {
+    if (processor->nof_prb() == nof_prb) {
+      continue;
+    }
+    if (!processor->set_nof_prb(nof_prb)) {
+      spdlog::error("Could not resize MBSFN processor {} for {} PRB", processor->id(), nof_prb);
+    }
+    resized++;
+  }
+  if (resized > 0) {
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    _fft_wisdom->add_planning_time(duration);
+    spdlog::info("Resized {} MBSFN processors for {} PRB in {} ms", resized, nof_prb, duration.count() / 1000);
+  }
+
+  // Parked processors stay parked, and so do the ones that could not be resized: they are tried again
+  // on the next sync, instead of being taken from the idle list only to drop their subframes.
+  auto parked = _parked_processors.size();
+  _parked_processors.clear();
+  for (size_t i = 0; i < resizing.size(); i++) {
+    if (i < parked || resizing[i]->nof_prb() != nof_prb) {
+      _parked_processors.push_back(resizing[i]);
+    } else {
+      _idle_processors->try_push(resizing[i]);
+    }
+  }
+}
+
+void ReceiveChain::retune_for_search() {
+  _sdr->stop();
+  _sample_rate = _search_sample_rate;  // sample rate for searching
+  _sdr->tune(_frequency, _sample_rate, _bandwidth, _gain, _antenna, _use_agc);
+  _sdr->start();
+}
+
+void ReceiveChain::run() {
+  // Elevate execution to real time scheduling
+  struct sched_param thread_param = {};
+  thread_param.sched_priority = 20;
+  _cfg.lookupValue("modem.phy.main_thread_priority_rt", thread_param.sched_priority);
+
+  spdlog::info("Raising main thread to realtime scheduling priority {}", thread_param.sched_priority);
+  int error = pthread_setschedparam(pthread_self(), SCHED_RR, &thread_param);
+  if (error != 0) {
+    spdlog::error("Cannot set main thread priority to realtime: {}. Thread will run at default priority.", strerror(error));
+  }
+
+  // Start receiving sample data
+  _sdr->start();
+
+  uint32_t tti = 0;
+  uint32_t tick = 0;
+
+  // Initial state: searching a cell
+  _state = searching;
+
+  // Start the main processing loop
+  while (_running) {
+    if (_state == searching) {
+      if (_restart) {
+        retune_for_search();
+      }
+
+      // We're at the search sample rate, and there's no point in creating a sample file. Stop the sample writer, if enabled.
+      _sdr->disableSampleFileWriting();
+
+      // In searching state, clear the receive buffer and try to find a cell at the configured frequency and synchronize with it
+      _restart = false;
+      _sdr->clear_buffer();
+      bool cell_found = _phy->cell_search();
+      if (cell_found) {
+        // A cell has been found. We now know the required number of PRB = bandwidth of the carrier. Set the approproiate
+        // sample rate...
+        _cas_nof_prb = _mbsfn_nof_prb = _phy->nr_prb();
+
+        if (!_options.sample_file.empty() && _options.file_bw) {
+          // Samples files are recorded at a fixed sample rate that can be determined from the bandwidth command line argument.
+          // If we're decoding from file, do not readjust the rate to match the CAS PRBs, but stay at this rate and instead configure the
+          // PHY to decode a narrow CAS from a wider channel.
+          _mbsfn_nof_prb = _options.file_bw * 5;
+          _phy->set_nof_mbsfn_prb(_mbsfn_nof_prb);
+          _phy->set_cell();
+        } else {
+          // When decoding from the air, configure the SDR accordingly
+          unsigned new_srate = srsran_sampling_freq_hz(_cas_nof_prb);
+          spdlog::info("Setting sample rate {} Mhz for {} PRB / {} Mhz channel width", new_srate/1000000.0, _phy->nr_prb(),
+              _phy->nr_prb() * 0.2);
+          _sdr->stop();
+
+          _bandwidth = (_cas_nof_prb * 200000) * 1.2;
+          _sdr->tune(_frequency, new_srate, _bandwidth, _gain, _antenna, _use_agc);
+
+          _sdr->start();
+        }
+        spdlog::debug("Synchronizing subframe");
+        // ... and move to syncing state.
+        _state = syncing;
+      } else {
+        sleep(1);
+      }
+    } else if (_state == syncing) {
+      // In syncing state, we already know the cell we want to camp on, and the SDR is tuned to the required
+      // sample rate for its number of PRB / bandwidth. We now synchronize PSS/SSS and receive the MIB once again
+      // at this sample rate.
+      // Size the MBSFN processors for the sample rate while none of them is processing. FFT planning takes
+      // long enough to overrun the SDR buffer, so start reading from a clean one afterwards.
+      resize_processors(_mbsfn_nof_prb);
+      _sdr->clear_buffer();
+
+      unsigned max_frames = 200;
+      bool sfn_sync = false;
+      while (!sfn_sync && max_frames-- > 0) {
+        sfn_sync = _phy->synchronize_subframe();
+      }
+
+      if (max_frames == 0 && !sfn_sync) {
+        // Failed. Back to square one: search state.
+        spdlog::warn("Synchronization failed. Going back to search state.");
+        _state = searching;
+        sleep(1);
+      }
+
+      if (sfn_sync) {
+        // We're locked on to the cell, and have succesfully received the MIB at the target sample rate.
+        spdlog::info("Decoded MIB at target sample rate, TTI is {}. Subframe synchronized.", _phy->tti());
+
+        // Set the cell parameters in the CAS processor
+        _cas_processor->set_cell(_phy->cell());
+        // Cell search, sync and resizing the processors have planned FFTs for the new cell
+        _fft_wisdom->note_planning();
+
+        // Get the initial TTI / subframe ID (= system frame number * 10 + subframe number)
+        tti = _phy->tti();
+        // Reset the RRC
+        _rrc->reset();
+
+        // Ready to receive actual data. Go to processing state.
+        _state = processing;
+
+        // If sample file creation is enabled, start writing out samples now that we're at the target sample rate
+        _sdr->enableSampleFileWriting();
+      }
+    } else {  // processing
+      while (_state == processing && _running) {
+        tti = (tti + 1) % 10240; // Clamp the TTI
+        if (_phy->is_cas_subframe(tti)) {
+          // Get the samples from the SDR interface, hand them to a CAS processor, and start it
+          // on a thread from the pool.
+          if (!_restart && _phy->get_next_frame(_cas_processor->rx_buffer(), _cas_processor->rx_buffer_size())) {
+            spdlog::debug("sending tti {} to regular processor", tti);
+            if (!_pool->push(process_cas, skip_cas, _cas_processor.get(), tti, _cas_budget, 0)) {
+              spdlog::warn("PHY job queue full, dropping CAS subframe {}", tti);
+              _cas_processor->unlock();
+            }
+
+            if (_phy->nof_mbsfn_prb() != _mbsfn_nof_prb)
+            {
+              // Handle the non-LTE bandwidths (6, 7 and 8 MHz). In these cases, CAS stays at the original bandwidth, but the MBSFN
+              // portion of the frames can be wider. We need to...
+
+              _mbsfn_nof_prb = _phy->nof_mbsfn_prb();
+
+              // ...adjust the SDR's sample rate to fit the wider MBSFN bandwidth...
+              unsigned new_srate = srsran_sampling_freq_hz(_mbsfn_nof_prb);
+              spdlog::info("Setting sample rate {} Mhz for MBSFN with {} PRB / {} Mhz channel width", new_srate/1000000.0, _mbsfn_nof_prb,
+                  _mbsfn_nof_prb * 0.2);
+              _sdr->stop();
+
+              _bandwidth = (_mbsfn_nof_prb * 200000) * 1.2;
+              _sdr->tune(_frequency, new_srate, _bandwidth, _gain, _antenna, _use_agc);
+
+              // ... configure the PHY and CAS processor to decode a narrow CAS and wider MBSFN, and move back to syncing state
+              // after reconfiguring and restarting the SDR.
+              _phy->set_cell();
+              _cas_processor->set_cell(_phy->cell());
+
+              _sdr->start();
+              spdlog::info("Synchronizing subframe after PRB extension");
+              _state = syncing;
+            }
+          } else {
+            // Failed to receive data, or sync lost. Go back to searching state.
+            retune_for_search();
+            _rrc->reset();
+            _phy->reset();
+
+            sleep(1);
+            _state = searching;
+          }
+        } else {
+          // All other frames in FeMBMS dedicated mode are MBSFN frames.
+          // Take any idle MBSFN processor. If all of them are busy, wait for one or drop the subframe.
+          MbsfnFrameProcessor* mbsfn_processor = nullptr;
+          if (!_idle_processors->try_pop(mbsfn_processor) && !_drop_when_busy) {
+            // Block until a processor returns itself. Stopping the modem ends the wait, also if a processor is stuck.
+            auto stall_start = std::chrono::steady_clock::now();
+            while (_running && !_idle_processors->wait_pop(mbsfn_processor, std::chrono::milliseconds(10))) {}
+            _rest_handler->_mbsfn_dispatch.stalls++;
+            _rest_handler->_mbsfn_dispatch.stall_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - stall_start).count();
+          }
+
+          // Processors are resized in syncing state. One that was still busy then is parked when it comes back,
+          // and the next idle one is taken instead.
+          while (mbsfn_processor != nullptr && mbsfn_processor->nof_prb() != _mbsfn_nof_prb) {
+            _parked_processors.push_back(mbsfn_processor);
+            if (!_idle_processors->try_pop(mbsfn_processor)) {
+              mbsfn_processor = nullptr;
+            }
+          }
+
+          cf_t** rx_buffer = _drop_buffer;
+          uint32_t rx_buffer_size = _drop_buffer_size;
+          if (mbsfn_processor != nullptr) {
+            spdlog::debug("sending tti {} to mbsfn proc {}", tti, static_cast<void*>(mbsfn_processor));
+            rx_buffer = mbsfn_processor->rx_buffer();
+            rx_buffer_size = mbsfn_processor->rx_buffer_size();
+          } else {
+            spdlog::debug("No idle MBSFN processor, dropping tti {}", tti);
+            _rest_handler->_mbsfn_dispatch.dropped++;
+          }
+
+          // Get the samples from the SDR interface, hand them to the MBSFN processor, and start it
+          // on a thread from the pool.
+          if (!_restart && _phy->get_next_frame(rx_buffer, rx_buffer_size)) {
+            if (mbsfn_processor == nullptr) {
+              // Subframe dropped, the samples went to the scratch buffer.
+            } else if (_phy->mcch_configured() && _phy->is_mbsfn_subframe(tti)) {
+              // If data frm SIB1/SIB13 has been received in CAS, configure the processors accordingly
+              if (!mbsfn_processor->mbsfn_configured()) {
+                // Cell, area and subcarrier spacing from the same configuration snapshot
+                srsran_scs_t scs = SRSRAN_SCS_15KHZ;
+                srsran_cell_t cell = {};
+                uint8_t area_id = 0;
+                {
+                  auto config = _phy->config();
+                  switch (config->mbsfn_subcarrier_spacing()) {
+                    case Phy::SubcarrierSpacing::df_15kHz:  scs = SRSRAN_SCS_15KHZ; break;
+                    case Phy::SubcarrierSpacing::df_7kHz5:  scs = SRSRAN_SCS_7KHZ5; break;
+                    case Phy::SubcarrierSpacing::df_1kHz25: scs = SRSRAN_SCS_1KHZ25; break;
+                  }
+                  cell = config->cell;
+                  area_id = config->sib13.mbsfn_area_info_list[0].mbsfn_area_id;
+                }
+                cell.nof_prb = cell.mbsfn_prb;
+                if (mbsfn_processor->set_cell(cell)) {
+                  mbsfn_processor->configure_mbsfn(area_id, scs);
+                  _fft_wisdom->note_planning();
+                } else {
+                  // No buffers for the cell, parked until the next sync resizes it
+                  _parked_processors.push_back(mbsfn_processor);
+                  mbsfn_processor = nullptr;
+                  _rest_handler->_mbsfn_dispatch.dropped++;
+                }
+              }
+              auto slot = mbsfn_processor != nullptr ? _mch_reorder->reserve(tti) : nullptr;
+              if (mbsfn_processor == nullptr) {
+                spdlog::debug("No MBSFN processor for the cell, dropping MBSFN subframe {}", tti);
+              } else if (slot == nullptr) {
+                spdlog::debug("MCH reorder window full, dropping MBSFN subframe {}", tti);
+                mbsfn_processor->release();
+              } else {
+                mbsfn_processor->set_reorder_slot(slot);
+                unsigned mch_idx = 0;
+                auto budget = _phy->mbsfn_config_for_tti(tti, mch_idx).is_mcch ? _mcch_budget : _mtch_budget;
+                if (!_pool->push(process_mbsfn, skip_mbsfn, mbsfn_processor, tti, budget,
+                      mbsfn_processor->id() + 1)) {
+                  spdlog::warn("PHY job queue full, dropping MBSFN subframe {}", tti);
+                  mbsfn_processor->release();
+                  _mch_reorder->complete(slot, false);
+                }
+              }
+            } else {
+              // Nothing to do yet, we lack the data from SIB1/SIB13
+              // Discard the samples and return the processor to the idle list.
+              mbsfn_processor->release();
+            }
+          } else {
+            if (mbsfn_processor != nullptr) {
+              mbsfn_processor->release();
+            }
+            // Failed to receive data, or sync lost. Go back to searching state.
+            spdlog::warn("Synchronization lost while processing. Going back to searching state.");
+            retune_for_search();
+
+            _state = searching;
+            sleep(1);
+            _rrc->reset();
+            _phy->reset();
+          }
+        }
+
+        tick++;
+        if (tick%100 == 0) {
+          apply_scaling(_scaler->evaluate(_rest_handler->_mbsfn_dispatch.decoded,
+                _rest_handler->_mbsfn_dispatch.decode_us,
+                _rest_handler->_mbsfn_dispatch.stalls + _rest_handler->_mbsfn_dispatch.dropped));
+        }
+        if (tick%_measurement_interval == 0) {
+          log_measurements();
+        }
+      }
+    }
+  }
+
+  shutdown();
+}
+
+/**
+ * Output rx info to the measurement file and to syslog. Called once per measurement interval.
+ */
+void ReceiveChain::log_measurements() {
+  // Collect the relevant info and write it out.
+  std::vector<std::string> cols;
+  _phy->flows().update_rates();
+
+  spdlog::info("CINR {:.2f} dB", _rest_handler->cinr_db() );
+  cols.push_back(std::to_string(_rest_handler->cinr_db()));
+
+  spdlog::info("PDSCH: MCS {}, BLER {}, BER {}, decode {:.1f} us/TB, {} iterations max",
+      _rest_handler->_pdsch.mcs.load(),
+      ((_rest_handler->_pdsch.errors * 1.0) / (_rest_handler->_pdsch.total * 1.0)),
+      _rest_handler->_pdsch.ber, _rest_handler->_pdsch.avg_decode_us(),
+      _rest_handler->_pdsch.iteration_cap.load());
+  cols.push_back(std::to_string(_rest_handler->_pdsch.mcs.load()));
+  cols.push_back(std::to_string(((_rest_handler->_pdsch.errors * 1.0) / (_rest_handler->_pdsch.total * 1.0))));
+  cols.push_back(std::to_string(_rest_handler->_pdsch.ber));
+
+  spdlog::info("MCCH: MCS {}, BLER {}, BER {}, decode {:.1f} us/TB, {} iterations max",
+      _rest_handler->_mcch.mcs.load(),
+      ((_rest_handler->_mcch.errors * 1.0) / (_rest_handler->_mcch.total * 1.0)),
+      _rest_handler->_mcch.ber, _rest_handler->_mcch.avg_decode_us(),
+      _rest_handler->_mcch.iteration_cap.load());
+
+  cols.push_back(std::to_string(_rest_handler->_mcch.mcs.load()));
+  cols.push_back(std::to_string(((_rest_handler->_mcch.errors * 1.0) / (_rest_handler->_mcch.total * 1.0))));
+  cols.push_back(std::to_string(_rest_handler->_mcch.ber));
+
+  auto mch_info = _phy->mch_info();
+  int mch_idx = 0;
+  std::for_each(std::begin(mch_info), std::end(mch_info), [&cols, &mch_idx, this](Phy::mch_info_t const& mch) {
+      spdlog::info("MCH {}: MCS {}, BLER {}, BER {}, decode {:.1f} us/TB, {} iterations max",
+          mch_idx,
+          mch.mcs,
+          (_rest_handler->_mch[mch_idx].errors * 1.0) / (_rest_handler->_mch[mch_idx].total * 1.0),
+          _rest_handler->_mch[mch_idx].ber, _rest_handler->_mch[mch_idx].avg_decode_us(),
+          _rest_handler->_mch[mch_idx].iteration_cap.load());
+      cols.push_back(std::to_string(mch_idx));
+      cols.push_back(std::to_string(mch.mcs));
+      cols.push_back(std::to_string((_rest_handler->_mch[mch_idx].errors * 1.0) / (_rest_handler->_mch[mch_idx].total * 1.0)));
+      cols.push_back(std::to_string(_rest_handler->_mch[mch_idx].ber));
+
+      int mtch_idx = 0;
+      std::for_each(std::begin(mch.mtchs), std::end(mch.mtchs), [&mtch_idx, &mch_idx, this](Phy::mtch_info_t const& mtch) {
+        auto flow = _phy->flows().flow(static_cast<uint32_t>(mch_idx), static_cast<uint32_t>(mtch.lcid));
+        spdlog::info("    MTCH {}: LCID {}, TMGI 0x{}, {}, {:.1f} packets/s, {:.1f} kbit/s, latency p50 < {} us, p99 < {} us",
+          mtch_idx,
+          mtch.lcid,
+          mtch.tmgi,
+          flow.dest,
+          flow.packets_per_s, flow.bits_per_s / 1000,
+          flow.latency_percentile_us(0.5), flow.latency_percentile_us(0.99));
+        mtch_idx++;
+          });
+        mch_idx++;
+      });
+
+  // Per service statistics, after the MCH columns
+  mch_idx = 0;
+  std::for_each(std::begin(mch_info), std::end(mch_info), [&cols, &mch_idx, this](Phy::mch_info_t const& mch) {
+      std::for_each(std::begin(mch.mtchs), std::end(mch.mtchs), [&cols, &mch_idx, this](Phy::mtch_info_t const& mtch) {
+        auto flow = _phy->flows().flow(static_cast<uint32_t>(mch_idx), static_cast<uint32_t>(mtch.lcid));
+        cols.push_back(mtch.tmgi);
+        cols.push_back(std::to_string(flow.packets_per_s));
+        cols.push_back(std::to_string(flow.bits_per_s / 1000));
+        cols.push_back(std::to_string(flow.latency_percentile_us(0.99)));
+          });
+        mch_idx++;
+      });
+  auto latency = _pool->dispatch_latency(true);
+  spdlog::info("PHY pool: {} jobs, dispatch latency avg {:.1f} us, max {} us, {} rejected, {} late, {} stolen",
+      latency.jobs, latency.avg_us, latency.max_us, latency.rejected, latency.late, latency.stolen);
+  if (_decode_pool) {
+    auto decode_latency = _decode_pool->dispatch_latency(true);
+    spdlog::info("PMCH decode pool: {} jobs, dispatch latency avg {:.1f} us, max {} us, {} rejected",
+        decode_latency.jobs, decode_latency.avg_us, decode_latency.max_us, decode_latency.rejected);
+  }
+  auto decoded = _rest_handler->_mbsfn_dispatch.decoded.load();
+  spdlog::info("MBSFN stages: FFT/CE avg {:.1f} us, PMCH decode avg {:.1f} us",
+      decoded ? _rest_handler->_mbsfn_dispatch.fft_us.load() * 1.0 / decoded : 0.0,
+      decoded ? _rest_handler->_mbsfn_dispatch.pmch_us.load() * 1.0 / decoded : 0.0);
+  spdlog::info("Late subframes skipped: CAS {}, MCCH {}, MTCH {}",
+      _rest_handler->_late_drops.cas.load(), _rest_handler->_late_drops.mcch.load(),
+      _rest_handler->_late_drops.mtch.load());
+  spdlog::info("MBSFN processors: {} of {} active, decode time {:.0f} us, {} stalls ({} us), {} dropped subframes",
+      _rest_handler->_mbsfn_dispatch.active_processors.load(), _thread_cnt, _scaler->decode_time_us(),
+      _rest_handler->_mbsfn_dispatch.stalls.load(), _rest_handler->_mbsfn_dispatch.stall_us.load(),
+      _rest_handler->_mbsfn_dispatch.dropped.load());
+  auto delivered = _rest_handler->_mch_reorder.delivered.load();
+  spdlog::info("MCH reorder: {} delivered, {} skipped, {} overflows",
+      delivered, _rest_handler->_mch_reorder.skipped.load(),
+      _rest_handler->_mch_reorder.overflows.load());
+  spdlog::info("MCH delivery: queue depth {}, avg reorder wait {:.1f} us, avg queue wait {:.1f} us, avg MAC/RLC/GW {:.1f} us",
+      _mch_reorder->delivery_queue_depth(),
+      delivered ? _rest_handler->_mch_reorder.reorder_wait_us.load() * 1.0 / delivered : 0.0,
+      delivered ? _rest_handler->_mch_reorder.queue_wait_us.load() * 1.0 / delivered : 0.0,
+      delivered ? _rest_handler->_mch_reorder.deliver_us.load() * 1.0 / delivered : 0.0);
+  if (_gw->udp_egress()) {
+    auto batches = _rest_handler->_udp_egress.batches.load();
+    spdlog::info("UDP egress: {} packets, {} bytes, {:.1f} packets per sendmmsg, {} errors, {} dropped",
+        _rest_handler->_udp_egress.packets.load(), _rest_handler->_udp_egress.bytes.load(),
+        batches ? _rest_handler->_udp_egress.packets.load() * 1.0 / batches : 0.0,
+        _rest_handler->_udp_egress.errors.load(), _rest_handler->_udp_egress.dropped.load());
+  }
+  if (_gw->shm_egress()) {
+    spdlog::info("Shared memory egress: {} packets, {} bytes, {} ring updates, {} dropped",
+        _rest_handler->_shm_egress.packets.load(), _rest_handler->_shm_egress.bytes.load(),
+        _rest_handler->_shm_egress.flushes.load(), _rest_handler->_shm_egress.dropped.load());
+  }
+  if (_gw->pcap_enabled()) {
+    spdlog::info("Packet capture: {} packets, {} dropped, {} errors, {} bytes in {} file(s)",
+        _rest_handler->_pcap.captured.load(), _rest_handler->_pcap.dropped.load(),
+        _rest_handler->_pcap.errors.load(), _rest_handler->_pcap.bytes.load(), _rest_handler->_pcap.files.load());
+  }
+  spdlog::info("GW checksums: {} IP headers corrected, {} UDP checksums corrected, {} malformed packets",
+      _rest_handler->_checksum.ip_corrected.load(), _rest_handler->_checksum.udp_corrected.load(),
+      _rest_handler->_checksum.malformed.load());
+  for (unsigned i = 0; i < _gw->queue_count(); i++) {
+    spdlog::info("TUN queue {}: {} packets, {} bytes, {} writes, {} errors", i,
+        _rest_handler->_tun_queues[i].packets.load(), _rest_handler->_tun_queues[i].bytes.load(),
+        _rest_handler->_tun_queues[i].writes.load(), _rest_handler->_tun_queues[i].errors.load());
+  }
+  spdlog::info("-----");
+  if (_enable_measurement_file) {
+    _measurement_file->WriteLogValues(cols);
+  }
+
+  // Keep the plans created for the current cell, in case we do not get to save them on shutdown.
+  // Only exports the wisdom if plans may have been created since the last save.
+  _fft_wisdom->save();
+}
+
+void ReceiveChain::shutdown() {
+  // Main loop ended. Wait for the subframes in flight.
+  spdlog::info("Shutting down");
+  _sdr->stop();
+  for (unsigned wait_ms = 0; wait_ms < 1000 &&
+      _idle_processors->size() + _parked_processors.size() < _mbsfn_processors.size(); wait_ms++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // Waits for a CAS subframe in flight
+  _cas_processor->rx_buffer();
+  _cas_processor->unlock();
+  _fft_wisdom->save();
+}
@@ -0,0 +1,166 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <libconfig.h++>
+
+#include "CasFrameProcessor.h"
+#include "FftWisdom.h"
+#include "Gw.h"
+#include "MbsfnFrameProcessor.h"
+#include "MchDemux.h"
+#include "MchReorderBuffer.h"
+#include "MeasurementFileWriter.h"
+#include "Modem.h"
+#include "Phy.h"
+#include "PmchSequenceCache.h"
+#include "ProcessorScaler.h"
+#include "RestHandler.h"
+#include "Rrc.h"
+#include "SdrReader.h"
+#include "WorkerPool.h"
+#include "srsran/srsran.h"
+#include "srsran/upper/pdcp.h"
+#include "srsran/rlc/rlc.h"
+
+/**
+ *  The receive chain behind the Modem API: owns all components, and runs the state machine
+ *  (cell search, subframe synchronization, processing) that dispatches the received subframes
+ *  to the frame processors.
+ */
+class ReceiveChain {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param options Options that are not part of the configuration file
+     */
+    ReceiveChain(const libconfig::Config& cfg, const Modem::Options& options)
+      : _cfg(cfg)
+      , _options(options)
+      {}
+
+    /**
+     *  Default destructor. Frees the frame processors and all other components.
+     */
+    virtual ~ReceiveChain();
+
+    ReceiveChain(const ReceiveChain&) = delete;
+    ReceiveChain& operator=(const ReceiveChain&) = delete;
+
+    /**
+     *  Open and tune the SDR, and create all components. Returns false on failure.
+     */
+    bool init();
+
+    /**
+     *  Run the main processing loop on the calling thread until stop() is called, then wait for
+     *  the subframes in flight.
+     */
+    void run();
+
+    /**
+     *  Request the main processing loop to end. Can be called from any thread.
+     */
+    void stop() { _running = false; }
+
+    /**
+     *  Set the packet callback. Must be called before init().
+     */
+    void set_packet_callback(Modem::packet_callback_t callback) { _packet_callback = std::move(callback); }
+
+  private:
+    void set_params(const std::string& ant, unsigned fc, double g, unsigned sr, unsigned bw);
+    void apply_scaling(unsigned target);
+    void resize_processors(uint32_t nof_prb);
+    void retune_for_search();
+    void log_measurements();
+    void shutdown();
+
+    const libconfig::Config& _cfg;
+    Modem::Options _options;
+    Modem::packet_callback_t _packet_callback;
+
+    unsigned _sample_rate = 7680000;         /**< Sample rate of the SDR */
+    unsigned _search_sample_rate = 7680000;  /**< Sample rate of the SDR during cell search */
+    unsigned _frequency = 667000000;         /**< Center freqeuncy the SDR is tuned to */
+    uint32_t _bandwidth = 10000000;          /**< Low pass filter bandwidth for the SDR */
+    double _gain = 0.9;                      /**< Overall system gain for the SDR */
+    std::string _antenna = "LNAW";           /**< Antenna input to be used */
+    bool _use_agc = false;
+
+    unsigned _mbsfn_nof_prb = 0;
+    unsigned _cas_nof_prb = 0;
+
+    /**
+     *  Restart flag. Setting this to true triggers resynchronization with the current SDR parameters.
+     */
+    std::atomic<bool> _restart = {false};
+
+    /**
+     *  Run flag. Cleared by stop() to end the main loop.
+     */
+    std::atomic<bool> _running = {true};
+
+    int _rx_channels = 1;
+    unsigned _thread_cnt = 4;
+    std::chrono::microseconds _mtch_budget = std::chrono::milliseconds(4);
+    std::chrono::microseconds _mcch_budget = std::chrono::milliseconds(8);
+    std::chrono::microseconds _cas_budget = std::chrono::milliseconds(20);
+    bool _enable_measurement_file = false;
+    uint32_t _measurement_interval = 5000;
+    bool _drop_when_busy = false;
+
+    // Declared in construction order, so they are destroyed in reverse
+    std::unique_ptr<SdrReader> _sdr;
+    std::unique_ptr<FftWisdom> _fft_wisdom;
+    std::unique_ptr<WorkerPool> _decode_pool;
+    std::unique_ptr<WorkerPool> _pool;
+    std::unique_ptr<MeasurementFileWriter> _measurement_file;
+    std::unique_ptr<Phy> _phy;
+    state_t _state = searching;
+    std::unique_ptr<RestHandler> _rest_handler;
+    std::unique_ptr<srsran::pdcp> _pdcp;
+    std::unique_ptr<srsran::rlc> _rlc;
+    std::unique_ptr<srsran::timer_handler> _timers;
+    std::unique_ptr<Rrc> _rrc;
+    std::unique_ptr<Gw> _gw;
+    std::unique_ptr<CasFrameProcessor> _cas_processor;
+    std::unique_ptr<MchDemux> _mch_demux;
+    std::unique_ptr<MchReorderBuffer> _mch_reorder;
+    PmchSequenceCache _pmch_sequences;   /**< Shared by the MBSFN processors, must outlive them */
+    std::unique_ptr<MbsfnFrameProcessor::idle_list_t> _idle_processors;
+    std::vector<std::unique_ptr<MbsfnFrameProcessor>> _mbsfn_processors;
+    std::unique_ptr<ProcessorScaler> _scaler;
+    std::vector<MbsfnFrameProcessor*> _parked_processors;
+
+    // Samples of dropped subframes still have to be read from the SDR to keep the subframe timing.
+    // They are read into this scratch buffer.
+    uint32_t _drop_buffer_size = 0;
+    cf_t* _drop_buffer[SRSRAN_MAX_PORTS] = {};
+};
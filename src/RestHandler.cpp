@@ -101,16 +101,42 @@ void RestHandler::get(http_request message) {
           break;
       }
 
-      if (_phy.cell().nof_prb == _phy.cell().mbsfn_prb) {
-        state["nof_prb"] = value(_phy.cell().nof_prb);
-      } else {
-        state["nof_prb"] = value(_phy.cell().mbsfn_prb);
+      {
+        auto config = _phy.config();
+        if (config->cell.nof_prb == config->cell.mbsfn_prb) {
+          state["nof_prb"] = value(config->cell.nof_prb);
+        } else {
+          state["nof_prb"] = value(config->cell.mbsfn_prb);
+        }
+        state["cell_id"] = value(config->cell.id);
+        state["subcarrier_spacing"] = value(config->mbsfn_subcarrier_spacing_khz());
       }
-      state["cell_id"] = value(_phy.cell().id);
       state["cfo"] = value(_phy.cfo());
       state["cinr_db"] = value(cinr_db());
-      state["subcarrier_spacing"] = value(_phy.mbsfn_subcarrier_spacing_khz());
       message.reply(status_codes::OK, state);
+    } else if (paths[0] == "phy_status") {
+      value phy = value::object();
+      std::string busy_policy = "wait";
+      _cfg.lookupValue("modem.phy.busy_processor_policy", busy_policy);
+      phy["busy_processor_policy"] = value(busy_policy);
+      phy["processor_stalls"] = value(static_cast<uint64_t>(_mbsfn_dispatch.stalls));
+      phy["processor_stall_us"] = value(static_cast<uint64_t>(_mbsfn_dispatch.stall_us));
+      phy["processor_drops"] = value(static_cast<uint64_t>(_mbsfn_dispatch.dropped));
+      phy["late_drops_cas"] = value(static_cast<uint64_t>(_late_drops.cas));
+      phy["late_drops_mcch"] = value(static_cast<uint64_t>(_late_drops.mcch));
+      phy["late_drops_mtch"] = value(static_cast<uint64_t>(_late_drops.mtch));
+      phy["active_processors"] = value(_mbsfn_dispatch.active_processors.load());
+      phy["decode_time_us"] = value(_mbsfn_dispatch.decode_time_us.load());
+      phy["fft_us"] = value(static_cast<uint64_t>(_mbsfn_dispatch.fft_us));
+      phy["pmch_us"] = value(static_cast<uint64_t>(_mbsfn_dispatch.pmch_us));
+      phy["reorder_delivered"] = value(static_cast<uint64_t>(_mch_reorder.delivered));
+      phy["reorder_skipped"] = value(static_cast<uint64_t>(_mch_reorder.skipped));
+      phy["reorder_overflows"] = value(static_cast<uint64_t>(_mch_reorder.overflows));
+      phy["delivery_queue_depth"] = value(static_cast<uint64_t>(_mch_reorder.queue_depth));
+      phy["reorder_wait_us"] = value(static_cast<uint64_t>(_mch_reorder.reorder_wait_us));
+      phy["delivery_queue_wait_us"] = value(static_cast<uint64_t>(_mch_reorder.queue_wait_us));
+      phy["delivery_us"] = value(static_cast<uint64_t>(_mch_reorder.deliver_us));
+      message.reply(status_codes::OK, phy);
     } else if (paths[0] == "sdr_params") {
       value sdr = value::object();
       sdr["frequency"] = value(_sdr.get_frequency());
@@ -130,7 +156,9 @@ void RestHandler::get(http_request message) {
       sdr["bler"] = value(static_cast<float>(_pdsch.errors) /
                                 static_cast<float>(_pdsch.total));
       sdr["ber"] = value(_pdsch.ber);
-      sdr["mcs"] = value(_pdsch.mcs);
+      sdr["mcs"] = value(_pdsch.mcs.load());
+      sdr["decode_time_us"] = value(_pdsch.avg_decode_us());
+      sdr["iteration_cap"] = value(_pdsch.iteration_cap.load());
       sdr["present"] = 1;
       message.reply(status_codes::OK, sdr);
     } else if (paths[0] == "pdsch_data") {
@@ -141,7 +169,9 @@ void RestHandler::get(http_request message) {
       sdr["bler"] = value(static_cast<float>(_mcch.errors) /
                                 static_cast<float>(_mcch.total));
       sdr["ber"] = value(_mcch.ber);
-      sdr["mcs"] = value(_mcch.mcs);
+      sdr["mcs"] = value(_mcch.mcs.load());
+      sdr["decode_time_us"] = value(_mcch.avg_decode_us());
+      sdr["iteration_cap"] = value(_mcch.iteration_cap.load());
       sdr["present"] = 1;
       message.reply(status_codes::OK, sdr);
     } else if (paths[0] == "mcch_data") {
@@ -150,34 +180,114 @@ void RestHandler::get(http_request message) {
     } else if (paths[0] == "mch_info") {
       std::vector<value> mi;
       auto mch_info = _phy.mch_info();
-      std::for_each(std::begin(mch_info), std::end(mch_info), [&mi](Phy::mch_info_t const& mch) {
+      uint32_t mch_idx = 0;
+      std::for_each(std::begin(mch_info), std::end(mch_info), [&mi, &mch_idx, this](Phy::mch_info_t const& mch) {
           value m;
           m["mcs"] = value(mch.mcs);
           std::vector<value> mti;
-          std::for_each(std::begin(mch.mtchs), std::end(mch.mtchs), [&mti](Phy::mtch_info_t const& mtch) {
+          std::for_each(std::begin(mch.mtchs), std::end(mch.mtchs), [&mti, &mch_idx, this](Phy::mtch_info_t const& mtch) {
               value mt;
               mt["tmgi"] = value(mtch.tmgi);
-              mt["dest"] = value(mtch.dest);
+              auto flow = _phy.flows().flow(mch_idx, static_cast<uint32_t>(mtch.lcid));
+              mt["dest"] = value(flow.dest);
+              mt["packets_per_s"] = value(flow.packets_per_s);
+              mt["bits_per_s"] = value(flow.bits_per_s);
               mt["lcid"] = value(mtch.lcid);
               mti.push_back(mt);
           });
           m["mtchs"] = value::array(mti);
           mi.push_back(m);
+          mch_idx++;
       });
       message.reply(status_codes::OK, value::array(mi));
     } else if (paths[0] == "mch_status") {
-      int idx = std::stoi(paths[1]);
+      unsigned idx = std::stoul(paths[1]);
+      if (idx >= _mch.size()) {
+        message.reply(status_codes::NotFound);
+        return;
+      }
       value sdr = value::object();
       sdr["bler"] = value(static_cast<float>(_mch[idx].errors) /
                                 static_cast<float>(_mch[idx].total));
       sdr["ber"] = value(_mch[idx].ber);
-      sdr["mcs"] = value(_mch[idx].mcs);
-      sdr["present"] = value(_mch[idx].present);
+      sdr["mcs"] = value(_mch[idx].mcs.load());
+      sdr["decode_time_us"] = value(_mch[idx].avg_decode_us());
+      sdr["iteration_cap"] = value(_mch[idx].iteration_cap.load());
+      sdr["present"] = value(_mch[idx].present.load());
       message.reply(status_codes::OK, sdr);
     } else if (paths[0] == "mch_data") {
-      int idx = std::stoi(paths[1]);
+      unsigned idx = std::stoul(paths[1]);
+      if (idx >= _mch.size()) {
+        message.reply(status_codes::NotFound);
+        return;
+      }
       auto cestream = Concurrency::streams::bytestream::open_istream(_mch[idx].GetData());
       message.reply(status_codes::OK, cestream);
+    } else if (paths[0] == "tun_status") {
+      std::vector<value> queues;
+      for (unsigned i = 0; i < _tun_queue_count; i++) {
+        value q = value::object();
+        q["packets"] = value(static_cast<uint64_t>(_tun_queues[i].packets));
+        q["bytes"] = value(static_cast<uint64_t>(_tun_queues[i].bytes));
+        q["errors"] = value(static_cast<uint64_t>(_tun_queues[i].errors));
+        q["writes"] = value(static_cast<uint64_t>(_tun_queues[i].writes));
+        queues.push_back(q);
+      }
+      message.reply(status_codes::OK, value::array(queues));
+    } else if (paths[0] == "flows") {
+      std::vector<value> flows;
+      for (const auto& flow : _phy.flows().snapshot()) {
+        value f = value::object();
+        f["mch"] = value(flow.mch_idx);
+        f["lcid"] = value(flow.lcid);
+        f["dest"] = value(flow.dest);
+        f["changes"] = value(flow.changes);
+        f["packets"] = value(flow.packets);
+        f["bytes"] = value(flow.bytes);
+        f["packets_per_s"] = value(flow.packets_per_s);
+        f["bits_per_s"] = value(flow.bits_per_s);
+        std::vector<value> latency;
+        for (unsigned i = 0; i < FlowTable::LATENCY_BUCKETS; i++) {
+          value bucket = value::object();
+          if (i < FlowTable::LATENCY_BUCKETS - 1) {
+            bucket["below_us"] = value(static_cast<uint64_t>(1ULL << i));
+          }
+          bucket["packets"] = value(flow.latency[i]);
+          latency.push_back(bucket);
+        }
+        f["latency"] = value::array(latency);
+        flows.push_back(f);
+      }
+      message.reply(status_codes::OK, value::array(flows));
+    } else if (paths[0] == "udp_egress_status") {
+      value udp = value::object();
+      udp["packets"] = value(static_cast<uint64_t>(_udp_egress.packets));
+      udp["bytes"] = value(static_cast<uint64_t>(_udp_egress.bytes));
+      udp["batches"] = value(static_cast<uint64_t>(_udp_egress.batches));
+      udp["errors"] = value(static_cast<uint64_t>(_udp_egress.errors));
+      udp["dropped"] = value(static_cast<uint64_t>(_udp_egress.dropped));
+      message.reply(status_codes::OK, udp);
+    } else if (paths[0] == "shm_egress_status") {
+      value shm = value::object();
+      shm["packets"] = value(static_cast<uint64_t>(_shm_egress.packets));
+      shm["bytes"] = value(static_cast<uint64_t>(_shm_egress.bytes));
+      shm["flushes"] = value(static_cast<uint64_t>(_shm_egress.flushes));
+      shm["dropped"] = value(static_cast<uint64_t>(_shm_egress.dropped));
+      message.reply(status_codes::OK, shm);
+    } else if (paths[0] == "pcap_status") {
+      value pcap = value::object();
+      pcap["captured"] = value(static_cast<uint64_t>(_pcap.captured));
+      pcap["dropped"] = value(static_cast<uint64_t>(_pcap.dropped));
+      pcap["errors"] = value(static_cast<uint64_t>(_pcap.errors));
+      pcap["bytes"] = value(static_cast<uint64_t>(_pcap.bytes));
+      pcap["files"] = value(static_cast<uint64_t>(_pcap.files));
+      message.reply(status_codes::OK, pcap);
+    } else if (paths[0] == "checksum_status") {
+      value checksum = value::object();
+      checksum["ip_corrected"] = value(static_cast<uint64_t>(_checksum.ip_corrected));
+      checksum["udp_corrected"] = value(static_cast<uint64_t>(_checksum.udp_corrected));
+      checksum["malformed"] = value(static_cast<uint64_t>(_checksum.malformed));
+      message.reply(status_codes::OK, checksum);
     } else if (paths[0] == "log") {
       std::string logfile = "/var/log/syslog";
 
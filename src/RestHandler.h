@@ -18,6 +18,8 @@
 //
 
 #pragma once
+#include <array>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
@@ -77,12 +79,21 @@ class RestHandler {
           std::lock_guard<std::mutex> lock(_data_mutex);
           return _data; 
         };
-        bool present = false;
-        int mcs = 0;
+        std::atomic<bool> present = {false};
+        std::atomic<int> mcs = {0};
         double ber;
-        unsigned total = 1;
-        unsigned errors = 0;
+        std::atomic<unsigned> total = {1};
+        std::atomic<unsigned> errors = {0};
+        std::atomic<unsigned> iteration_cap = {0};  /**< Current turbo decoder iteration cap */
+
+        void add_decode_time(uint64_t us) { _decode_us += us; _decoded++; }
+        double avg_decode_us() const {
+          auto decoded = _decoded.load();
+          return decoded ? static_cast<double>(_decode_us.load()) / decoded : 0.0;
+        }
       private:
+        std::atomic<uint64_t> _decode_us = {0};
+        std::atomic<uint64_t> _decoded = {0};
         std::vector<uint8_t> _data = {};
         std::mutex _data_mutex;
     };
@@ -103,9 +114,130 @@ class RestHandler {
     ChannelInfo _mcch;
 
     /**
-     *  RX info for MCHs
+     *  RX info for MCHs, indexed by MCH index. Fixed size, so frame processors can
+     *  update it concurrently.
+     */
+    std::array<ChannelInfo, MAX_MCH> _mch;
+
+    /**
+     *  Dispatch counters for the MBSFN processors, maintained by the main loop
+     */
+    struct DispatchInfo {
+      std::atomic<uint64_t> stalls = {0};    /**< Subframes the main loop had to wait for an idle processor */
+      std::atomic<uint64_t> stall_us = {0};  /**< Total time spent waiting for an idle processor */
+      std::atomic<uint64_t> dropped = {0};   /**< Subframes dropped because no processor was idle */
+      std::atomic<uint64_t> decoded = {0};   /**< Subframes decoded by the MBSFN processors */
+      std::atomic<uint64_t> decode_us = {0}; /**< Total processing time of these subframes */
+      std::atomic<uint64_t> fft_us = {0};    /**< Part of decode_us spent in FFT / channel estimation */
+      std::atomic<uint64_t> pmch_us = {0};   /**< Part of decode_us spent in PMCH decoding */
+      std::atomic<unsigned> active_processors = {0};  /**< Current size of the active processor set */
+      std::atomic<unsigned> decode_time_us = {0};     /**< Moving average of the per-subframe processing time */
+    };
+
+    /**
+     *  Dispatch info for the MBSFN processors
+     */
+    DispatchInfo _mbsfn_dispatch;
+
+    /**
+     *  Subframes skipped by the PHY workers because they were picked up after their deadline
+     */
+    struct LateDropInfo {
+      std::atomic<uint64_t> cas = {0};
+      std::atomic<uint64_t> mcch = {0};
+      std::atomic<uint64_t> mtch = {0};
+    };
+
+    /**
+     *  Late drops per channel
      */
-    std::map<uint32_t, ChannelInfo> _mch;
+    LateDropInfo _late_drops;
+
+    /**
+     *  Counters of the MCH reorder buffer
+     */
+    struct ReorderInfo {
+      std::atomic<uint64_t> delivered = {0};  /**< Transport blocks delivered to MAC/RLC in order */
+      std::atomic<uint64_t> skipped = {0};    /**< Subframes skipped because they were not decoded in time */
+      std::atomic<uint64_t> overflows = {0};  /**< Subframes dropped because the reorder window was full */
+      std::atomic<uint64_t> queue_depth = {0};     /**< Transport blocks waiting for the delivery thread */
+      std::atomic<uint64_t> reorder_wait_us = {0}; /**< Total time between decode and queueing for delivery */
+      std::atomic<uint64_t> queue_wait_us = {0};   /**< Total time spent in the delivery queue */
+      std::atomic<uint64_t> deliver_us = {0};      /**< Total time spent in MAC/RLC/PDCP/GW */
+    };
+
+    /**
+     *  Reorder info for the MCH
+     */
+    ReorderInfo _mch_reorder;
+
+    /**
+     *  Counters of one TUN queue
+     */
+    struct TunQueueInfo {
+      std::atomic<uint64_t> packets = {0};
+      std::atomic<uint64_t> bytes = {0};
+      std::atomic<uint64_t> errors = {0};   /**< Packets lost in failed and short writes */
+      std::atomic<uint64_t> writes = {0};   /**< write / writev calls */
+    };
+
+    /**
+     *  Per TUN queue counters. The first _tun_queue_count entries are in use.
+     */
+    std::array<TunQueueInfo, MAX_MCH> _tun_queues;
+    std::atomic<unsigned> _tun_queue_count = {0};
+
+    /**
+     *  Counters of the UDP egress
+     */
+    struct UdpEgressInfo {
+      std::atomic<uint64_t> packets = {0};
+      std::atomic<uint64_t> bytes = {0};     /**< UDP payload bytes sent */
+      std::atomic<uint64_t> batches = {0};   /**< sendmmsg calls */
+      std::atomic<uint64_t> errors = {0};
+      std::atomic<uint64_t> dropped = {0};   /**< Packets that are not complete UDP datagrams */
+    };
+
+    /**
+     *  UDP egress info
+     */
+    UdpEgressInfo _udp_egress;
+
+    /**
+     *  Counters of the shared memory egress
+     */
+    struct ShmEgressInfo {
+      std::atomic<uint64_t> packets = {0};
+      std::atomic<uint64_t> bytes = {0};
+      std::atomic<uint64_t> flushes = {0};   /**< Updates of the ring's write position */
+      std::atomic<uint64_t> dropped = {0};   /**< Packets too large for the ring */
+    };
+
+    ShmEgressInfo _shm_egress;
+
+    /**
+     *  Checksum verification counters of the gateway
+     */
+    struct ChecksumInfo {
+      std::atomic<uint64_t> ip_corrected = {0};
+      std::atomic<uint64_t> udp_corrected = {0};
+      std::atomic<uint64_t> malformed = {0};   /**< Packets with an invalid IPv4 header or UDP length */
+    };
+
+    ChecksumInfo _checksum;
+
+    /**
+     *  Counters of the packet capture
+     */
+    struct PcapTapInfo {
+      std::atomic<uint64_t> captured = {0};
+      std::atomic<uint64_t> dropped = {0};   /**< Not captured because the writer had fallen behind */
+      std::atomic<uint64_t> errors = {0};    /**< Lost in failed file writes */
+      std::atomic<uint64_t> bytes = {0};     /**< Bytes written to the capture files */
+      std::atomic<uint64_t> files = {0};
+    };
+
+    PcapTapInfo _pcap;
 
     /**
      *  Current CINR value
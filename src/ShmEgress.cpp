@@ -0,0 +1,150 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "ShmEgress.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#include "spdlog/spdlog.h"
+
+ShmEgress::ShmEgress(const libconfig::Config& cfg, RestHandler& rest)
+  : _cfg(cfg)
+  , _rest(rest) {
+  _cfg.lookupValue("modem.gw.shm.name", _name);
+}
+
+ShmEgress::~ShmEgress() {
+  if (_header != nullptr) {
+    flush();
+    _header->state.store(PACKET_RING_STATE_CLOSED, std::memory_order_release);
+    _header->notify.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, &_header->notify, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+    munmap(_header, _map_size);
+  }
+}
+
+auto ShmEgress::init() -> bool {
+  unsigned size_mb = 64;
+  _cfg.lookupValue("modem.gw.shm.size_mb", size_mb);
+  _capacity = 1ULL << 20;
+  while (_capacity < static_cast<uint64_t>(std::max(size_mb, 1U)) << 20) {
+    _capacity <<= 1;
+  }
+  _map_size = PACKET_RING_HEADER_SIZE + _capacity;
+
+  // Always start with a new object. Readers that still have the previous one mapped see it closed.
+  shm_unlink(_name.c_str());
+  int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    spdlog::error("Failed to create shared memory object {}: {}", _name, strerror(errno));
+    return false;
+  }
+  if (ftruncate(fd, static_cast<off_t>(_map_size)) < 0) {
+    spdlog::error("Failed to size shared memory object {}: {}", _name, strerror(errno));
+    close(fd);
+    shm_unlink(_name.c_str());
+    return false;
+  }
+  void* map = mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    spdlog::error("Failed to map shared memory object {}: {}", _name, strerror(errno));
+    shm_unlink(_name.c_str());
+    return false;
+  }
+
+  _header = new (map) PacketRingHeader();
+  _data = static_cast<uint8_t*>(map) + PACKET_RING_HEADER_SIZE;
+  _header->version = PACKET_RING_VERSION;
+  _header->header_size = PACKET_RING_HEADER_SIZE;
+  _header->capacity = _capacity;
+  _header->state.store(PACKET_RING_STATE_RUNNING, std::memory_order_relaxed);
+  _header->write_pos.store(0, std::memory_order_relaxed);
+  _header->reclaim_pos.store(0, std::memory_order_relaxed);
+  _header->notify.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _header->magic = PACKET_RING_MAGIC;
+
+  spdlog::info("Shared memory egress: {}, {} MB ring", _name, _capacity >> 20);
+  return true;
+}
+
+void ShmEgress::write(uint32_t mch_idx, uint32_t lcid, const srsran::byte_buffer_t& pdu) {
+  uint64_t size = (sizeof(PacketRingRecord) + pdu.N_bytes + PACKET_RING_ALIGN - 1) & ~(PACKET_RING_ALIGN - 1ULL);
+  if (size > _capacity / 4) {
+    _rest._shm_egress.dropped++;
+    return;
+  }
+
+  uint64_t offset = _pos & (_capacity - 1);
+  uint64_t padding = offset + size > _capacity ? _capacity - offset : 0;
+  uint64_t end = _pos + padding + size;
+
+  // Tell the readers which data is about to be overwritten before touching it
+  if (end > _capacity) {
+    _header->reclaim_pos.store(end - _capacity, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  if (padding > 0) {
+    auto pad = reinterpret_cast<PacketRingRecord*>(_data + offset);
+    *pad = {};
+    pad->size = static_cast<uint32_t>(padding);
+    pad->flags = PACKET_RING_FLAG_PADDING;
+    offset = 0;
+  }
+
+  auto record = reinterpret_cast<PacketRingRecord*>(_data + offset);
+  record->size = static_cast<uint32_t>(size);
+  record->length = pdu.N_bytes;
+  record->flags = 0;
+  record->mch_idx = static_cast<uint16_t>(mch_idx);
+  record->lcid = static_cast<uint16_t>(lcid);
+  record->timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+  record->reserved = 0;
+  memcpy(record + 1, pdu.msg, pdu.N_bytes);
+
+  _pos = end;
+  _pending = true;
+  _rest._shm_egress.packets++;
+  _rest._shm_egress.bytes += pdu.N_bytes;
+}
+
+void ShmEgress::flush() {
+  if (!_pending) {
+    return;
+  }
+  _pending = false;
+  _header->write_pos.store(_pos, std::memory_order_release);
+  _header->notify.fetch_add(1, std::memory_order_release);
+  syscall(SYS_futex, &_header->notify, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+  _rest._shm_egress.flushes++;
+}
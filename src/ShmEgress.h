@@ -0,0 +1,92 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <libconfig.h++>
+
+#include "srsran/srsran.h"
+#include "srsran/common/byte_buffer.h"
+
+#include "PacketRing.h"
+#include "RestHandler.h"
+
+/**
+ *  Shared memory egress for the network gateway.
+ *
+ *  Publishes the decoded IP packets into a ring in a POSIX shared memory object, so middleware on
+ *  the same host can read them in place without a TUN interface and a copy through the kernel
+ *  per packet. See PacketRing.h for the format, and packet_ring/PacketRingReader.h for the reader.
+ *
+ *  Packets are written into the ring immediately and made visible to the readers on flush(),
+ *  at the end of each delivery cycle. Must only be used from the delivery thread.
+ */
+class ShmEgress {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param rest RESTful API handler reference
+     */
+    ShmEgress(const libconfig::Config& cfg, RestHandler& rest);
+
+    /**
+     *  Default destructor. Marks the ring closed and unmaps it. The object stays in place
+     *  for the readers that still have it mapped.
+     */
+    virtual ~ShmEgress();
+
+    ShmEgress(const ShmEgress&) = delete;
+    ShmEgress& operator=(const ShmEgress&) = delete;
+
+    /**
+     *  Create the shared memory object and initialize the ring. Returns false on failure.
+     */
+    bool init();
+
+    /**
+     *  Write a decoded IP packet into the ring.
+     *
+     *  @param mch_idx MCH index
+     *  @param lcid Logical channel the packet was received on
+     *  @param pdu The IP packet
+     */
+    void write(uint32_t mch_idx, uint32_t lcid, const srsran::byte_buffer_t& pdu);
+
+    /**
+     *  Publish the packets written since the last call to the readers
+     */
+    void flush();
+
+  private:
+    const libconfig::Config& _cfg;
+    RestHandler& _rest;
+
+    std::string _name = "/5gmag-rt-modem-packets";
+    size_t _map_size = 0;
+    PacketRingHeader* _header = nullptr;
+    uint8_t* _data = nullptr;
+    uint64_t _capacity = 0;
+    uint64_t _pos = 0;          /**< End of the last record written */
+    bool _pending = false;
+};
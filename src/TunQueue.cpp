@@ -0,0 +1,273 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "TunQueue.h"
+
+#include <arpa/inet.h>
+#include <linux/if_tun.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+#include "Checksum.h"
+
+// Not defined by older kernel headers
+#ifndef TUN_F_USO4
+#define TUN_F_USO4 0x20
+#endif
+
+/**
+ *  struct virtio_net_hdr. linux/virtio_net.h cannot be included from C++. Host byte order.
+ */
+struct VnetHdr {
+  uint8_t flags;
+  uint8_t gso_type;
+  uint16_t hdr_len;
+  uint16_t gso_size;
+  uint16_t csum_start;
+  uint16_t csum_offset;
+};
+static const uint8_t kVnetHdrNeedsCsum = 1;  // VIRTIO_NET_HDR_F_NEEDS_CSUM
+static const uint8_t kVnetHdrGsoUdpL4 = 5;   // VIRTIO_NET_HDR_GSO_UDP_L4
+
+// Packets collected per queue before they are written out, even without a flush
+static const size_t kMaxBatch = 64;
+// Packets handed over to the writer thread, about 20 maximum size transport blocks
+static const size_t kHandoffSize = 4096;
+// Max. number of datagrams the kernel splits one UDP GSO packet into
+static const size_t kMaxGsoSegments = 64;
+static const uint32_t kUdpIpHdrLen = sizeof(iphdr) + sizeof(udphdr);
+
+/**
+ *  Length of the UDP payload, if the packet can be part of a GSO super-packet. 0 otherwise.
+ */
+static auto gso_payload_len(const srsran::byte_buffer_t& pdu) -> uint32_t {
+  if (pdu.N_bytes <= kUdpIpHdrLen) {
+    return 0;
+  }
+  auto ip_hdr = reinterpret_cast<const iphdr*>(pdu.msg);
+  auto udp_hdr = reinterpret_cast<const udphdr*>(pdu.msg + sizeof(iphdr));
+  if (ip_hdr->version != 4 || ip_hdr->ihl != 5 || ip_hdr->protocol != IPPROTO_UDP ||
+      (ntohs(ip_hdr->frag_off) & (IP_MF | IP_OFFMASK)) != 0 ||
+      ntohs(ip_hdr->tot_len) != pdu.N_bytes || ntohs(udp_hdr->len) != pdu.N_bytes - sizeof(iphdr)) {
+    return 0;
+  }
+  return pdu.N_bytes - kUdpIpHdrLen;
+}
+
+static auto same_flow(const srsran::byte_buffer_t& a, const srsran::byte_buffer_t& b) -> bool {
+  auto ip_a = reinterpret_cast<const iphdr*>(a.msg);
+  auto ip_b = reinterpret_cast<const iphdr*>(b.msg);
+  auto udp_a = reinterpret_cast<const udphdr*>(a.msg + sizeof(iphdr));
+  auto udp_b = reinterpret_cast<const udphdr*>(b.msg + sizeof(iphdr));
+  return ip_a->saddr == ip_b->saddr && ip_a->daddr == ip_b->daddr && ip_a->tos == ip_b->tos &&
+    ip_a->ttl == ip_b->ttl && udp_a->source == udp_b->source && udp_a->dest == udp_b->dest;
+}
+
+TunQueue::TunQueue(int fd, bool gso, RestHandler::TunQueueInfo& stats, bool writer_thread)
+  : _fd(fd)
+  , _gso(gso)
+  , _stats(stats) {
+  _pending.reserve(kMaxBatch);
+  if (writer_thread) {
+    _handoff = std::make_unique<SpscQueue<srsran::byte_buffer_t*>>(kHandoffSize);
+    sem_init(&_ready, 0, 0);
+    _writer = std::thread{&TunQueue::writer_loop, this};
+  }
+}
+
+TunQueue::~TunQueue() {
+  if (_writer.joinable()) {
+    _stop = true;
+    sem_post(&_ready);
+    _writer.join();
+    sem_destroy(&_ready);
+  }
+  close(_fd);
+}
+
+auto TunQueue::enable_gso(int fd) -> bool {
+  return ioctl(fd, TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_USO4) == 0;
+}
+
+void TunQueue::add(srsran::unique_byte_buffer_t pdu) {
+  if (_handoff) {
+    if (!_handoff->try_push(pdu.get())) {
+      // Writer thread too slow, the packet is freed here
+      _stats.errors++;
+      return;
+    }
+    pdu.release();
+    _handed_off = true;
+    return;
+  }
+  _pending.push_back(std::move(pdu));
+  if (_pending.size() == kMaxBatch) {
+    flush();
+  }
+}
+
+void TunQueue::flush() {
+  if (_handoff) {
+    if (_handed_off) {
+      _handed_off = false;
+      sem_post(&_ready);
+    }
+    return;
+  }
+  write_pending();
+}
+
+void TunQueue::writer_loop() {
+  srsran::byte_buffer_t* pdu = nullptr;
+  for (;;) {
+    while (sem_wait(&_ready) != 0 && errno == EINTR) {}
+
+    // Everything handed over since the last wakeup, in batches of up to kMaxBatch
+    while (_handoff->try_pop(pdu)) {
+      _pending.emplace_back(pdu);
+      if (_pending.size() == kMaxBatch) {
+        write_pending();
+      }
+    }
+    write_pending();
+
+    if (_stop) {
+      break;
+    }
+  }
+}
+
+void TunQueue::write_pending() {
+  size_t i = 0;
+  while (i < _pending.size()) {
+    auto count = _gso ? gso_run(i) : 1;
+    write_packets(i, count);
+    i += count;
+  }
+  _pending.clear();
+}
+
+auto TunQueue::gso_run(size_t start) const -> size_t {
+  const auto& first = *_pending[start];
+  auto segment_len = gso_payload_len(first);
+  if (segment_len == 0) {
+    return 1;
+  }
+
+  // All segments have the size of the first one, only the last one may be shorter
+  size_t count = 1;
+  uint32_t total = segment_len;
+  while (start + count < _pending.size() && count < kMaxGsoSegments) {
+    const auto& next = *_pending[start + count];
+    auto len = gso_payload_len(next);
+    if (len == 0 || len > segment_len || !same_flow(first, next) || kUdpIpHdrLen + total + len > UINT16_MAX) {
+      break;
+    }
+    total += len;
+    count++;
+    if (len < segment_len) {
+      break;
+    }
+  }
+  return count;
+}
+
+auto TunQueue::write_packets(size_t start, size_t count) -> bool {
+  ssize_t expected = 0;
+  ssize_t n = 0;
+
+  if (!_gso) {
+    expected = _pending[start]->N_bytes;
+    n = write(_fd, _pending[start]->msg, _pending[start]->N_bytes);
+  } else if (count == 1) {
+    VnetHdr vnet_hdr = {};
+    std::array<iovec, 2> iov = {{
+      {&vnet_hdr, sizeof(vnet_hdr)},
+      {_pending[start]->msg, _pending[start]->N_bytes}
+    }};
+    expected = sizeof(vnet_hdr) + _pending[start]->N_bytes;
+    n = writev(_fd, iov.data(), iov.size());
+  } else {
+    // Super-packet: the headers of the first datagram, followed by the payloads of all of them
+    uint32_t payload_len = 0;
+    for (auto i = start; i < start + count; i++) {
+      payload_len += _pending[i]->N_bytes - kUdpIpHdrLen;
+    }
+
+    std::array<uint8_t, kUdpIpHdrLen> headers = {};
+    memcpy(headers.data(), _pending[start]->msg, kUdpIpHdrLen);
+    auto ip_hdr = reinterpret_cast<iphdr*>(headers.data());
+    auto udp_hdr = reinterpret_cast<udphdr*>(headers.data() + sizeof(iphdr));
+    ip_hdr->tot_len = htons(static_cast<uint16_t>(kUdpIpHdrLen + payload_len));
+    ip_hdr->check = Checksum::ip_header(ip_hdr);
+    udp_hdr->len = htons(static_cast<uint16_t>(sizeof(udphdr) + payload_len));
+
+    // The kernel completes the UDP checksum of each segment, starting from the pseudo header sum
+    udp_hdr->check = Checksum::fold(Checksum::udp_pseudo_header(ip_hdr, udp_hdr->len));
+
+    VnetHdr vnet_hdr = {};
+    vnet_hdr.flags = kVnetHdrNeedsCsum;
+    vnet_hdr.gso_type = kVnetHdrGsoUdpL4;
+    vnet_hdr.hdr_len = kUdpIpHdrLen;
+    vnet_hdr.gso_size = static_cast<uint16_t>(_pending[start]->N_bytes - kUdpIpHdrLen);
+    vnet_hdr.csum_start = sizeof(iphdr);
+    vnet_hdr.csum_offset = offsetof(udphdr, check);
+
+    std::array<iovec, kMaxGsoSegments + 2> iov = {};
+    iov[0] = {&vnet_hdr, sizeof(vnet_hdr)};
+    iov[1] = {headers.data(), headers.size()};
+    for (size_t i = 0; i < count; i++) {
+      iov[i + 2] = {_pending[start + i]->msg + kUdpIpHdrLen, _pending[start + i]->N_bytes - kUdpIpHdrLen};
+    }
+    expected = sizeof(vnet_hdr) + kUdpIpHdrLen + payload_len;
+    n = writev(_fd, iov.data(), static_cast<int>(count + 2));
+  }
+
+  _stats.writes++;
+  if (n > 0 && n != expected) {
+    spdlog::warn("DL TUN/TAP short write");
+  }
+  if (n == 0) {
+    spdlog::warn("DL TUN/TAP 0 write");
+  }
+  if (n < 0) {
+    spdlog::warn("DL TUN/TAP write error  {}", strerror(errno));
+  }
+  if (n != expected) {
+    _stats.errors += count;
+    return false;
+  }
+
+  uint64_t bytes = 0;
+  for (auto i = start; i < start + count; i++) {
+    bytes += _pending[i]->N_bytes;
+  }
+  _stats.packets += count;
+  _stats.bytes += bytes;
+  return true;
+}
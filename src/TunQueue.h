@@ -0,0 +1,103 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <semaphore.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "srsran/srsran.h"
+#include "srsran/common/byte_buffer.h"
+
+#include "BoundedQueue.h"
+#include "RestHandler.h"
+
+/**
+ *  One queue of the TUN interface: its file descriptor, and the packets collected for it
+ *  in the current delivery cycle.
+ *
+ *  With UDP segmentation offload (gso = true, the descriptor must have been opened with IFF_VNET_HDR),
+ *  consecutive datagrams of the same UDP flow and size are coalesced into one super-packet and
+ *  written with a single writev. The kernel splits it into the original datagrams again. All other
+ *  packets are written one by one.
+ *
+ *  With its own writer thread, add() only hands the packets over, and the thread writes them out after
+ *  each flush(). Every queue of a multi-queue interface has its own, so the writes of different MCHs run
+ *  concurrently on their own descriptors, without a lock. Without it, flush() writes on the calling thread.
+ */
+class TunQueue {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param fd TUN queue file descriptor. Closed on destruction.
+     *  @param gso true if fd carries virtio net headers and the interface accepts UDP segmentation offload
+     *  @param stats Counters for this queue
+     *  @param writer_thread true to write from a thread of its own instead of the thread calling flush()
+     */
+    TunQueue(int fd, bool gso, RestHandler::TunQueueInfo& stats, bool writer_thread = false);
+
+    /**
+     *  Default destructor. Writes the handed over packets, stops the writer thread and closes the descriptor.
+     */
+    virtual ~TunQueue();
+
+    TunQueue(const TunQueue&) = delete;
+    TunQueue& operator=(const TunQueue&) = delete;
+
+    /**
+     *  Queue a packet. It is written on the next flush(), or immediately if the batch is full.
+     */
+    void add(srsran::unique_byte_buffer_t pdu);
+
+    /**
+     *  Write all queued packets, or wake up the writer thread to write them
+     */
+    void flush();
+
+    /**
+     *  Enable UDP segmentation offload on the TUN interface. Returns false if the kernel does not support it.
+     *
+     *  @param fd Any queue of the interface, opened with IFF_VNET_HDR
+     */
+    static bool enable_gso(int fd);
+
+  private:
+    void write_pending();
+    size_t gso_run(size_t start) const;
+    bool write_packets(size_t start, size_t count);
+    void writer_loop();
+
+    int _fd;
+    bool _gso;
+    RestHandler::TunQueueInfo& _stats;
+    std::vector<srsran::unique_byte_buffer_t> _pending;   /**< Owned by the writing thread */
+
+    std::unique_ptr<SpscQueue<srsran::byte_buffer_t*>> _handoff;   /**< Caller -> writer thread */
+    bool _handed_off = false;   /**< Packets added since the last flush() */
+    sem_t _ready = {};
+    std::atomic<bool> _stop = {false};
+    std::thread _writer;
+};
@@ -0,0 +1,213 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "UdpEgress.h"
+
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+static auto parse_address(const std::string& address, sockaddr_in& addr) -> bool {
+  auto colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    return false;
+  }
+  char* end = nullptr;
+  auto port = strtoul(address.c_str() + colon + 1, &end, 10);
+  if (*end != 0 || port == 0 || port > UINT16_MAX) {
+    return false;
+  }
+  addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  return inet_pton(AF_INET, address.substr(0, colon).c_str(), &addr.sin_addr) == 1;
+}
+
+UdpEgress::UdpEgress(const libconfig::Config& cfg, Phy& phy, RestHandler& rest)
+  : _cfg(cfg)
+  , _phy(phy)
+  , _rest(rest) {
+  _pending.reserve(kMaxBatch);
+
+  if (_cfg.exists("modem.gw.udp.destinations")) {
+    const libconfig::Setting& destinations = _cfg.lookup("modem.gw.udp.destinations");
+    for (int i = 0; i < destinations.getLength(); i++) {
+      Mapping mapping;
+      std::string address;
+      destinations[i].lookupValue("tmgi", mapping.tmgi);
+      destinations[i].lookupValue("lcid", mapping.lcid);
+      destinations[i].lookupValue("address", address);
+      if ((mapping.tmgi.empty() && mapping.lcid < 0) || !parse_address(address, mapping.addr)) {
+        spdlog::error("Ignoring invalid UDP egress destination {}", i);
+        continue;
+      }
+      spdlog::info("UDP egress: {} {} -> {}", mapping.tmgi.empty() ? "LCID" : "TMGI",
+          mapping.tmgi.empty() ? std::to_string(mapping.lcid) : mapping.tmgi, address);
+      _mappings.push_back(mapping);
+    }
+  }
+}
+
+UdpEgress::~UdpEgress() {
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+auto UdpEgress::init() -> bool {
+  _fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (_fd < 0) {
+    spdlog::error("Failed to create UDP egress socket: {}", strerror(errno));
+    return false;
+  }
+
+  int ttl = 1;
+  _cfg.lookupValue("modem.gw.udp.ttl", ttl);
+  if (setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+    spdlog::warn("Failed to set multicast TTL: {}", strerror(errno));
+  }
+
+  bool loopback = true;
+  _cfg.lookupValue("modem.gw.udp.loopback", loopback);
+  int loop = loopback ? 1 : 0;
+  if (setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+    spdlog::warn("Failed to set multicast loopback: {}", strerror(errno));
+  }
+
+  std::string interface_address;
+  _cfg.lookupValue("modem.gw.udp.interface_address", interface_address);
+  if (!interface_address.empty()) {
+    in_addr iface = {};
+    if (inet_pton(AF_INET, interface_address.c_str(), &iface) != 1 ||
+        setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0) {
+      spdlog::warn("Failed to set multicast interface {}", interface_address);
+    }
+  }
+
+  spdlog::info("UDP egress: multicast TTL {}, loopback {}, interface {}", ttl, loopback,
+      interface_address.empty() ? "default" : interface_address);
+  return true;
+}
+
+auto UdpEgress::destination(uint32_t mch_idx, uint32_t lcid) -> const Destination& {
+  auto config = _phy.config();
+  if (config->mch_generation != _generation) {
+    // New MCCH, or resync: the TMGIs have to be resolved again
+    _destinations.clear();
+    _generation = config->mch_generation;
+  }
+  auto key = std::make_pair(mch_idx, lcid);
+  auto it = _destinations.find(key);
+  if (it != _destinations.end()) {
+    return it->second;
+  }
+
+  // Resolved once per MCH / LCID and MCCH. A TMGI mapping takes precedence over an LCID mapping.
+  auto tmgi = config->tmgi(mch_idx, lcid);
+
+  Destination dest;
+  for (const auto& mapping : _mappings) {
+    if (!mapping.tmgi.empty() && mapping.tmgi == tmgi) {
+      dest.mapped = true;
+      dest.addr = mapping.addr;
+      break;
+    }
+    if (!dest.mapped && mapping.tmgi.empty() && mapping.lcid == static_cast<int>(lcid)) {
+      dest.mapped = true;
+      dest.addr = mapping.addr;
+    }
+  }
+  return _destinations.emplace(key, dest).first->second;
+}
+
+void UdpEgress::send(uint32_t mch_idx, uint32_t lcid, srsran::unique_byte_buffer_t pdu) {
+  auto ip_hdr = reinterpret_cast<const iphdr*>(pdu->msg);
+  uint32_t ihl = 4U * ip_hdr->ihl;
+  if (pdu->N_bytes < sizeof(iphdr) || ip_hdr->version != 4 || ip_hdr->protocol != IPPROTO_UDP ||
+      ihl < sizeof(iphdr) || pdu->N_bytes < ihl + sizeof(udphdr) ||
+      (ntohs(ip_hdr->frag_off) & (IP_MF | IP_OFFMASK)) != 0) {
+    // Only complete UDP datagrams can be re-sent from a UDP socket
+    _rest._udp_egress.dropped++;
+    return;
+  }
+
+  auto udp_hdr = reinterpret_cast<const udphdr*>(pdu->msg + ihl);
+  uint32_t udp_len = std::min<uint32_t>(ntohs(udp_hdr->len), pdu->N_bytes - ihl);
+  if (udp_len < sizeof(udphdr)) {
+    _rest._udp_egress.dropped++;
+    return;
+  }
+
+  if (_pending.size() == kMaxBatch) {
+    flush();
+  }
+  auto idx = _pending.size();
+
+  const auto& dest = destination(mch_idx, lcid);
+  if (dest.mapped) {
+    _addrs[idx] = dest.addr;
+  } else {
+    _addrs[idx] = {};
+    _addrs[idx].sin_family = AF_INET;
+    _addrs[idx].sin_addr.s_addr = ip_hdr->daddr;
+    _addrs[idx].sin_port = udp_hdr->dest;
+  }
+
+  _iovs[idx].iov_base = pdu->msg + ihl + sizeof(udphdr);
+  _iovs[idx].iov_len = udp_len - sizeof(udphdr);
+  _msgs[idx] = {};
+  _msgs[idx].msg_hdr.msg_name = &_addrs[idx];
+  _msgs[idx].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+  _msgs[idx].msg_hdr.msg_iov = &_iovs[idx];
+  _msgs[idx].msg_hdr.msg_iovlen = 1;
+  _pending.push_back(std::move(pdu));
+}
+
+void UdpEgress::flush() {
+  unsigned count = _pending.size();
+  unsigned sent = 0;
+  while (sent < count) {
+    int n = sendmmsg(_fd, &_msgs[sent], count - sent, 0);
+    _rest._udp_egress.batches++;
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Skip the message that failed, and carry on with the rest
+      spdlog::debug("UDP egress send error: {}", strerror(errno));
+      _rest._udp_egress.errors++;
+      sent++;
+      continue;
+    }
+    for (auto i = sent; i < sent + static_cast<unsigned>(n); i++) {
+      _rest._udp_egress.bytes += _msgs[i].msg_len;
+    }
+    _rest._udp_egress.packets += static_cast<uint64_t>(n);
+    sent += static_cast<unsigned>(n);
+  }
+  _pending.clear();
+}
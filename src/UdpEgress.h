@@ -0,0 +1,119 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <libconfig.h++>
+
+#include "srsran/srsran.h"
+#include "srsran/common/byte_buffer.h"
+
+#include "Phy.h"
+#include "RestHandler.h"
+
+/**
+ *  UDP egress for the network gateway.
+ *
+ *  Instead of writing the decoded IP packets to a TUN interface, the UDP payloads are sent directly
+ *  from a UDP socket, so no TUN device is needed and the packets skip the routing stack.
+ *  The destination is taken from the packet's own IP/UDP header, or from the configured
+ *  mapping for its TMGI or LCID.
+ *
+ *  Packets are collected until flush() is called at the end of a delivery cycle, and sent
+ *  with one sendmmsg call. Must only be used from the delivery thread.
+ */
+class UdpEgress {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param phy PHY reference, for the TMGI of an MCH / LCID
+     *  @param rest RESTful API handler reference
+     */
+    UdpEgress(const libconfig::Config& cfg, Phy& phy, RestHandler& rest);
+
+    /**
+     *  Default destructor. Closes the socket.
+     */
+    virtual ~UdpEgress();
+
+    /**
+     *  Create the socket. Returns false on failure.
+     */
+    bool init();
+
+    /**
+     *  Queue a decoded IP packet for sending. Packets that are not UDP are dropped.
+     *
+     *  @param mch_idx MCH index
+     *  @param lcid Logical channel the packet was received on
+     *  @param pdu The IP packet
+     */
+    void send(uint32_t mch_idx, uint32_t lcid, srsran::unique_byte_buffer_t pdu);
+
+    /**
+     *  Send all queued packets
+     */
+    void flush();
+
+  private:
+    /**
+     *  Configured destination for a TMGI or LCID
+     */
+    struct Mapping {
+      std::string tmgi;
+      int lcid = -1;
+      sockaddr_in addr = {};
+    };
+
+    /**
+     *  Destination of an MCH / LCID, resolved on its first packet
+     */
+    struct Destination {
+      bool mapped = false;   /**< false: use the packet's own destination */
+      sockaddr_in addr = {};
+    };
+
+    const Destination& destination(uint32_t mch_idx, uint32_t lcid);
+
+    const libconfig::Config& _cfg;
+    Phy& _phy;
+    RestHandler& _rest;
+
+    int _fd = -1;
+    std::vector<Mapping> _mappings;
+    std::map<std::pair<uint32_t, uint32_t>, Destination> _destinations;
+    uint64_t _generation = 0;  /**< Phy::Config::mch_generation _destinations were resolved with */
+
+    static const unsigned kMaxBatch = 64;
+    std::array<mmsghdr, kMaxBatch> _msgs = {};
+    std::array<iovec, kMaxBatch> _iovs = {};
+    std::array<sockaddr_in, kMaxBatch> _addrs = {};
+    std::vector<srsran::unique_byte_buffer_t> _pending;  /**< Keeps the queued packets alive until sent */
+};
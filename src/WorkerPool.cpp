@@ -0,0 +1,216 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "WorkerPool.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+WorkerPool::WorkerPool(unsigned thread_count, int phy_prio, size_t queue_size)
+  : _thread_count(std::min(std::max(thread_count, 1U), MAX_THREADS))
+  , _wake(new sem_t[_thread_count]) {
+  if (_thread_count != thread_count) {
+    spdlog::error("Unsupported number of phy threads {}, using {}", thread_count, _thread_count);
+  }
+  for (unsigned i = 0; i < _thread_count; i++) {
+    _queues.emplace_back(new BoundedMpmcQueue<Job>(queue_size));
+    sem_init(&_wake[i], 0, 0);
+  }
+  _thread_limit = _thread_count;
+
+  struct sched_param thread_param = {};
+  thread_param.sched_priority = phy_prio;
+
+  for (unsigned i = 0; i < _thread_count; i++) {
+    spdlog::info("Launching phy thread with realtime scheduling priority {}", thread_param.sched_priority);
+    _workers.emplace_back(&WorkerPool::thread_loop, this, i);
+
+    int error = pthread_setschedparam(_workers.back().native_handle(), SCHED_RR, &thread_param);
+    if (error != 0) {
+      spdlog::error("Cannot set phy thread priority to realtime: {}. Thread will run at default priority.", strerror(error));
+    }
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  _stop = true;
+  for (unsigned i = 0; i < _thread_count; i++) {
+    sem_post(&_wake[i]);
+  }
+  for (auto& thread : _workers) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+  for (unsigned i = 0; i < _thread_count; i++) {
+    sem_destroy(&_wake[i]);
+  }
+}
+
+void WorkerPool::set_active_threads(unsigned count) {
+  count = std::min(std::max(count, 1U), _thread_count);
+  auto old = _thread_limit.exchange(count);
+  for (auto i = old; i < count; i++) {
+    sem_post(&_wake[i]);
+  }
+  if (count < old) {
+    // Jobs may be left in the rings of the parked workers. Let an active worker collect them.
+    wake(0);
+  }
+}
+
+auto WorkerPool::push(job_fn_t fn, job_fn_t skip, void* obj, uint32_t tti, std::chrono::microseconds budget,
+    unsigned affinity) -> bool {
+  Job job;
+  job.run = fn;
+  job.skip = skip;
+  job.obj = obj;
+  job.tti = tti;
+  job.dispatched = std::chrono::steady_clock::now();
+  job.deadline = budget.count() > 0 ? job.dispatched + budget : std::chrono::steady_clock::time_point::max();
+
+  // Queue on the preferred worker, or the next one with space in its ring
+  auto limit = _thread_limit.load(std::memory_order_relaxed);
+  auto home = affinity % limit;
+  bool queued = false;
+  for (unsigned n = 0; n < limit && !queued; n++) {
+    if (_queues[(home + n) % limit]->try_push(job)) {
+      home = (home + n) % limit;
+      queued = true;
+    }
+  }
+  if (!queued) {
+    _rejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Pairs with the fence after setting the sleeping bit in thread_loop: either the worker sees the job when it
+  // re-checks the rings, or we see it sleeping here.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto sleeping = _sleeping.load(std::memory_order_relaxed);
+  if (sleeping & (1ULL << home)) {
+    wake(home);
+  } else {
+    // The preferred worker is busy. Wake an idle one, it will steal the job if the owner
+    // has not picked it up by then.
+    auto idle = sleeping & (limit < 64 ? (1ULL << limit) - 1 : ~0ULL);
+    if (idle != 0) {
+      wake(static_cast<unsigned>(__builtin_ctzll(idle)));
+    }
+  }
+  return true;
+}
+
+void WorkerPool::wake(unsigned idx) {
+  _sleeping.fetch_and(~(1ULL << idx));
+  sem_post(&_wake[idx]);
+}
+
+auto WorkerPool::has_work() -> bool {
+  for (auto& queue : _queues) {
+    if (queue->size() > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto WorkerPool::steal(unsigned idx, Job& job) -> bool {
+  for (unsigned n = 1; n < _thread_count; n++) {
+    if (_queues[(idx + n) % _thread_count]->try_pop(job)) {
+      _stolen.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkerPool::thread_loop(unsigned idx) {
+  Job job;
+  while (!_stop) {
+    if (idx >= _thread_limit.load()) {
+      // Parked. Re-check the limit after waking, the wakeup may be stale.
+      while (sem_wait(&_wake[idx]) != 0 && errno == EINTR) {}
+      continue;
+    }
+
+    if (_queues[idx]->try_pop(job) || steal(idx, job)) {
+      execute(job);
+      continue;
+    }
+
+    _sleeping.fetch_or(1ULL << idx);
+    // Pairs with the fence in push(): either push() sees the sleeping bit, or the ring loads in
+    // has_work() see the job. Without it, the relaxed loads could be satisfied before the bit is visible.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (has_work() || _stop) {
+      _sleeping.fetch_and(~(1ULL << idx));
+      continue;
+    }
+    while (sem_wait(&_wake[idx]) != 0 && errno == EINTR) {}
+    _sleeping.fetch_and(~(1ULL << idx));
+  }
+}
+
+void WorkerPool::execute(Job& job) {
+  auto now = std::chrono::steady_clock::now();
+  if (now > job.deadline) {
+    _late.fetch_add(1, std::memory_order_relaxed);
+    job.skip(job.obj, job.tti);
+    return;
+  }
+
+  auto latency_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        now - job.dispatched).count());
+  _lat_jobs.fetch_add(1, std::memory_order_relaxed);
+  _lat_sum_us.fetch_add(latency_us, std::memory_order_relaxed);
+  auto max = _lat_max_us.load(std::memory_order_relaxed);
+  while (latency_us > max &&
+      !_lat_max_us.compare_exchange_weak(max, latency_us, std::memory_order_relaxed)) {}
+
+  _active.fetch_add(1, std::memory_order_relaxed);
+  job.run(job.obj, job.tti);
+  _active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+auto WorkerPool::dispatch_latency(bool reset) -> LatencyStats {
+  LatencyStats stats;
+  if (reset) {
+    stats.jobs = _lat_jobs.exchange(0, std::memory_order_relaxed);
+    auto sum = _lat_sum_us.exchange(0, std::memory_order_relaxed);
+    stats.max_us = _lat_max_us.exchange(0, std::memory_order_relaxed);
+    stats.rejected = _rejected.exchange(0, std::memory_order_relaxed);
+    stats.late = _late.exchange(0, std::memory_order_relaxed);
+    stats.stolen = _stolen.exchange(0, std::memory_order_relaxed);
+    stats.avg_us = stats.jobs ? static_cast<double>(sum) / stats.jobs : 0.0;
+  } else {
+    stats.jobs = _lat_jobs.load(std::memory_order_relaxed);
+    stats.max_us = _lat_max_us.load(std::memory_order_relaxed);
+    stats.rejected = _rejected.load(std::memory_order_relaxed);
+    stats.late = _late.load(std::memory_order_relaxed);
+    stats.stolen = _stolen.load(std::memory_order_relaxed);
+    stats.avg_us = stats.jobs ? static_cast<double>(_lat_sum_us.load(std::memory_order_relaxed)) / stats.jobs : 0.0;
+  }
+  return stats;
+}
@@ -0,0 +1,168 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <semaphore.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+
+/**
+ *  Realtime worker pool for the frame processors.
+ *
+ *  Jobs are plain descriptors (function pointer, processor pointer and TTI) that are copied
+ *  into preallocated lock-free rings, so dispatching a subframe never allocates or takes a lock.
+ *  Every job carries a deadline. A job that is picked up after its deadline is not run, its skip
+ *  function is called instead, so a worker that fell behind catches up instead of processing stale data.
+ *
+ *  Each worker has its own ring and its own wakeup semaphore. A job is queued on the worker
+ *  selected by its affinity, so the same processor object tends to run on the same worker and
+ *  keeps its buffers, FFT plans and channel estimates cache-hot. A worker only takes jobs from
+ *  other workers' rings when its own ring is empty. Workers beyond the active limit are parked
+ *  and take no jobs until the limit is raised again.
+ *
+ *  Owners and thieves both take the oldest job. Work-stealing deques that hand the owner the newest
+ *  job suit workers that queue their own follow-up work. Here, jobs come from the main loop, and
+ *  the oldest subframe is the one closest to its deadline and next in TTI order.
+ */
+class WorkerPool {
+  public:
+    /**
+     *  Job entry point. Receives the processor object and the TTI of the subframe.
+     */
+    typedef void (*job_fn_t)(void* obj, uint32_t tti);
+
+    /**
+     *  Job descriptor
+     */
+    struct Job {
+      job_fn_t run = nullptr;
+      job_fn_t skip = nullptr;
+      void* obj = nullptr;
+      uint32_t tti = 0;
+      std::chrono::steady_clock::time_point dispatched = {};
+      std::chrono::steady_clock::time_point deadline = {};
+    };
+
+    /**
+     *  Dispatch-to-start latency of the jobs executed since the last reset
+     */
+    struct LatencyStats {
+      uint64_t jobs = 0;
+      double avg_us = 0;
+      uint64_t max_us = 0;
+      uint64_t rejected = 0;
+      uint64_t late = 0;
+      uint64_t stolen = 0;
+    };
+
+    /**
+     *  Maximum number of workers
+     */
+    static const unsigned MAX_THREADS = 64;
+
+    /**
+     *  Default constructor.
+     *
+     *  @param thread_count Number of worker threads
+     *  @param phy_prio Realtime scheduling priority of the workers
+     *  @param queue_size Capacity of each worker's job ring
+     */
+    WorkerPool(unsigned thread_count, int phy_prio, size_t queue_size = 16);
+
+    /**
+     *  Default destructor. Stops and joins all workers.
+     */
+    virtual ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     *  Queue a job for execution. Can be called from any thread, including the workers of another pool.
+     *
+     *  Returns false if all job rings are full. Neither function is called in this case.
+     *
+     *  @param fn Job function
+     *  @param skip Called instead of fn if the job is started after its deadline
+     *  @param obj Processor object passed to fn / skip
+     *  @param tti TTI of the subframe
+     *  @param budget Time after dispatch at which the job is considered late. Zero for no deadline.
+     *  @param affinity Jobs with the same affinity are preferably run on the same worker
+     */
+    bool push(job_fn_t fn, job_fn_t skip, void* obj, uint32_t tti, std::chrono::microseconds budget, unsigned affinity);
+
+    /**
+     *  Number of worker threads
+     */
+    unsigned thread_count() const { return static_cast<unsigned>(_workers.size()); }
+
+    /**
+     *  Set the number of workers that take jobs. The remaining workers are parked.
+     *  Must only be called from one thread.
+     */
+    void set_active_threads(unsigned count);
+
+    /**
+     *  Number of workers that take jobs
+     */
+    unsigned active_threads() const { return _thread_limit.load(std::memory_order_relaxed); }
+
+    /**
+     *  Number of workers currently executing a job
+     */
+    unsigned active_count() const { return _active.load(std::memory_order_relaxed); }
+
+    /**
+     *  Get the dispatch-to-start latency statistics, and optionally reset them.
+     */
+    LatencyStats dispatch_latency(bool reset);
+
+  private:
+    void thread_loop(unsigned idx);
+    bool steal(unsigned idx, Job& job);
+    bool has_work();
+    void wake(unsigned idx);
+    void execute(Job& job);
+
+    unsigned _thread_count = 0;
+    std::vector<std::unique_ptr<BoundedMpmcQueue<Job>>> _queues;
+    std::unique_ptr<sem_t[]> _wake;
+    std::atomic<uint64_t> _sleeping = {0};     /**< Bitmask of workers waiting for a job */
+    std::atomic<unsigned> _thread_limit = {0};
+
+    std::atomic<bool> _stop = {false};
+    std::atomic<unsigned> _active = {0};
+
+    std::atomic<uint64_t> _lat_jobs = {0};
+    std::atomic<uint64_t> _lat_sum_us = {0};
+    std::atomic<uint64_t> _lat_max_us = {0};
+    std::atomic<uint64_t> _rejected = {0};
+    std::atomic<uint64_t> _late = {0};
+    std::atomic<uint64_t> _stolen = {0};
+
+    std::vector<std::thread> _workers;
+};
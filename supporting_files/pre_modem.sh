@@ -1,7 +1,7 @@
 #!/bin/bash
 
 echo $MODEM_TUN_INTERFACE
-ip tuntap add mode tun $MODEM_TUN_INTERFACE
+ip tuntap add mode tun multi_queue $MODEM_TUN_INTERFACE
 ifconfig $MODEM_TUN_INTERFACE up $MODEM_TUN_ADDRESS
 sysctl -w net.ipv4.conf.$MODEM_TUN_INTERFACE.rp_filter=0
 if [ "$ENABLE_MCAST_ROUTING" = true ] ; then